@@ -7,10 +7,18 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <chrono>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifndef _WIN32
+#include <sys/wait.h>
+#else
+#define realpath(N, R) _fullpath((R), (N), 0)
+#endif
 #include "austere_h.h"
+#include "austere_rt_c.h"
 #include "default_rc.h"
 
 using namespace std;
@@ -28,12 +36,15 @@ struct SourceFile;
 static map<string, int> global_symbol_flags;
 static map<string, string> global_symbol_parent;
 static map<string, string> global_symbol_sig;
+static map<string, string> async_functions;
+static set<string> export_symbols;
 static string prefix((char*)austere_h, austere_h_len);
 static string winrc((char*)default_rc, default_rc_len);
 static bool auto_output = false;
 static bool utf8 = true;
 static string systag;
 static string compiler = "cc";
+static string host_compiler = "cc";
 static string cpp_compiler = "c++";
 static string asm_compiler = "c++";
 static string linker;
@@ -46,6 +57,8 @@ static string ldflags = "-fvisibility=hidden -fPIC";
 static string cpu_flags = "-march=amdfam10 -mtune=znver1";
 static string release_flags = "-fomit-frame-pointer -ffast-math -fopenmp -flto=8 -fgraphite-identity -ftree-loop-distribution -floop-nest-optimize -Ofast -s";
 static string debug_flags = "-fstrict-aliasing -ffast-math -fopenmp -flto=8 -g";
+static string dev_flags = "-fstrict-aliasing -ffast-math -fopenmp -g -gsplit-dwarf";
+static string dev_ldflags;
 static string icon, manifest, details, vendor, product, version, copyright;
 static vector<string> libs;
 static vector<string> res_files;
@@ -53,6 +66,8 @@ static bool cs_use_res = false;
 static bool human = false;
 static vector<SourceFile*> files;
 static vector<string> c_files, rc_files, dll_files, cpp_files, asm_files, rs_files, cs_files;
+static vector<pair<string,string>> embeds;
+static vector<string> embed_files;
 static string build_dir = "build/";
 static string output = "";
 #ifdef _WIN32
@@ -65,8 +80,26 @@ static string dllext = ".so";
 static string exeext;
 #endif
 static bool debug_mode = false;
+static bool dev_mode = false;
+static bool prune_mode = false;
+static bool layout_mode = false;
+static bool openmp_mode = true;
+static bool csfast_mode = false;
+static bool optreport_mode = false;
+static bool bench_mode = false;
+static string bench_baseline;
+static vector<pair<SourceFile*, string> > opt_reports;
+static bool uses_runtime = false;
+static int shard_lines = 0;
+static int pointer_size = 8;
+static int wide_align = 8;
+static long shard_bytes = 0;
+static int max_jobs = 0;
 static bool dll_mode = false;
 static bool quiet = true;
+static string pgo_command;
+static string autotune_command;
+static bool autotune_native = false;
 
 #ifdef _WIN32
 #define stat _stat
@@ -165,7 +198,384 @@ static string remove_empty_ifdefs(string h) {
     return out;
 }
 
-static void rewrite_structs(string& code, string& head, string& public_head, vector<string>& public_csv, string& local_head, string& tail, string space, int* outputToHeader, int isPacked, int isPublic, int isOpaque, int isPrivate, map<string,int>& symbol_flags) {
+static string read_symbol_backwards(string line, int pos);
+static void collect_identifiers(string code, set<string>& out);
+static bool is_vector_type(string t);
+static string trim_type(string type);
+
+struct StructField {
+    string type, name;
+    int count;
+    bool isolated, hot;
+};
+
+struct StructInfo {
+    vector<StructField> fields;
+    bool simple;
+    int isPacked;
+    int align, size;
+    int original_size;
+    bool reordered, inHeader, isWire, isPersistent;
+    unsigned long long wireHash;
+    string source;
+    int line;
+};
+static map<string, StructInfo> global_structs;
+
+static void parse_struct_fields(string code, StructInfo& info) {
+    auto cmt = code.find("//");
+    if (cmt != string::npos) code = code.substr(0, cmt);
+    code = trim(code);
+    if (!code.size()) return;
+    bool hot = (code.find("hot ") == 0);
+    if (hot) code = trim(code.substr(4));
+    bool isolated = (code.find("isolated ") == 0);
+    if (isolated) code = trim(code.substr(9));
+    if (code[code.size()-1] != ';' || code.find_first_of("(){}:") != string::npos) {
+        info.simple = false;
+        return;
+    }
+    code = trim(code.substr(0, code.size()-1));
+    string base;
+    int i = 0;
+    while (code.size()) {
+        auto comma = code.find(',');
+        string part = trim(code.substr(0, comma));
+        code = (comma == string::npos) ? "" : code.substr(comma+1);
+        StructField field;
+        field.count = 1;
+        field.isolated = isolated;
+        field.hot = hot;
+        auto lb = part.find('[');
+        if (lb != string::npos) {
+            auto rb = part.find(']', lb);
+            string n = (rb == string::npos) ? "" : trim(part.substr(lb+1, rb-lb-1));
+            field.count = atoi(n.c_str());
+            if (field.count <= 0 || n.find_first_not_of("0123456789") != string::npos || part.find('[', rb) != string::npos) {
+                info.simple = false;
+                return;
+            }
+            part = trim(part.substr(0, lb));
+        }
+        field.name = read_symbol_backwards(part, part.size());
+        string decl = trim(part.substr(0, part.size() - field.name.size()));
+        string stars;
+        for(auto c: decl) {
+            if (c == '*') stars += '*';
+        }
+        if (!i++) {
+            base = trim(decl.substr(0, decl.find('*')));
+        }
+        if (!field.name.size() || !base.size()) {
+            info.simple = false;
+            return;
+        }
+        field.type = base + stars;
+        info.fields.push_back(field);
+    }
+}
+
+static int type_layout(string type, int& align) {
+    const char* names[] = {"u8", "i8", "s8", "char", "u16", "i16", "s16", "f16", "short", "u32", "i32", "s32", "f32", "int", "float", "bool", "u64", "i64", "s64", "f64", "double", 0};
+    const int sizes[] = {1, 1, 1, 1, 2, 2, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 8, 8, 8, 8, 8};
+    if (type.size() && type[type.size()-1] == '*') {
+        align = pointer_size;
+        return pointer_size;
+    }
+    for(int i=0;names[i];i++) {
+        if (type == names[i]) {
+            align = sizes[i] == 8 ? wide_align : sizes[i];
+            return sizes[i];
+        }
+    }
+    if (is_vector_type(type)) {
+        align = (type == "i32x8" || type == "u32x8" || type == "i64x4" || type == "u64x4" || type == "f32x8" || type == "f64x4") ? 32 : 16;
+        return align;
+    }
+    auto it = global_structs.find(type);
+    if (it != global_structs.end() && it->second.size) {
+        align = it->second.align;
+        return it->second.size;
+    }
+    return 0;
+}
+
+// sizeof() of a simple struct as the C compiler will lay it out, 0 if a field type is unknown
+static void struct_layout(StructInfo& info, int align) {
+    int offset = 0;
+    info.size = 0;
+    info.align = align ? align : 1;
+    if (!info.simple) return;
+    for(auto& f: info.fields) {
+        int a = 1;
+        int size = type_layout(f.type, a);
+        if (!size) return;
+        if (info.isPacked) a = 1;
+        size *= f.count;
+        if (f.isolated) {
+            a = max(a, 64);
+            size = (size + 63) / 64 * 64;
+        }
+        offset = (offset + a - 1) / a * a + size;
+        info.align = max(info.align, a);
+    }
+    info.size = (offset + info.align - 1) / info.align * info.align;
+}
+
+static int field_align(StructField& f) {
+    int a = 1;
+    if (!type_layout(f.type, a)) return 0;
+    return f.isolated ? max(a, 64) : a;
+}
+
+// /LAYOUT: hot fields first, then largest alignment first, which leaves no holes between fields
+static bool reorder_fields(StructInfo& info) {
+    vector<StructField> sorted;
+    for(auto& f: info.fields) {
+        int a = field_align(f);
+        if (!a) return false;
+        int i = sorted.size();
+        while (i > 0 && ((f.hot && !sorted[i-1].hot) || (f.hot == sorted[i-1].hot && a > field_align(sorted[i-1])))) i--;
+        sorted.insert(sorted.begin() + i, f);
+    }
+    bool changed = false;
+    for(int i=0;i<sorted.size();i++) {
+        if (sorted[i].name != info.fields[i].name) changed = true;
+    }
+    info.fields = sorted;
+    return changed;
+}
+
+static string field_declarations(StructInfo& info, string indent) {
+    string out;
+    for(auto& f: info.fields) {
+        string decl = f.type + " " + f.name;
+        if (f.count > 1) decl += "[" + to_string(f.count) + "]";
+        decl += ";";
+        if (f.isolated) decl = "struct AU_ALIGNED(AU_CACHELINE) { " + decl + " };";
+        out += indent + decl + "\n";
+    }
+    return out;
+}
+
+// pahole-style listing of every struct auc could lay out
+static string layout_report() {
+    string out;
+    char buf[256];
+    for(auto& it: global_structs) {
+        StructInfo& info = it.second;
+        if (!info.source.size()) continue;
+        out += "/* " + info.source + ":" + to_string(info.line) + " */\nstruct " + it.first + " {\n";
+        if (!info.size) {
+            out += "\t/* layout unknown: " + string(info.simple ? "field of unknown size" : "not a plain field list") + " */\n};\n\n";
+            continue;
+        }
+        int offset = 0, holes = 0, hole_bytes = 0, sum = 0, line = 0;
+        for(auto& f: info.fields) {
+            int a = 1;
+            int size = type_layout(f.type, a) * f.count;
+            if (info.isPacked) a = 1;
+            if (f.isolated) a = max(a, 64);
+            int at = (offset + a - 1) / a * a;
+            if (at > offset) {
+                snprintf(buf, sizeof(buf), "\n\t/* XXX %d byte%s hole, try to pack */\n\n", at - offset, at - offset == 1 ? "" : "s");
+                out += buf;
+                holes++;
+                hole_bytes += at - offset;
+            }
+            if (at / 64 > line) {
+                line = at / 64;
+                snprintf(buf, sizeof(buf), "\t/* --- cacheline %d boundary (%d bytes) --- */\n", line, line * 64);
+                out += buf;
+            }
+            string decl = f.name;
+            if (f.count > 1) decl += "[" + to_string(f.count) + "]";
+            snprintf(buf, sizeof(buf), "\t%-24s %-24s /* %5d %5d */%s\n", f.type.c_str(), (decl + ";").c_str(), at, size, f.hot ? " /* hot */" : "");
+            out += buf;
+            if (f.isolated) size = (size + 63) / 64 * 64;
+            offset = at + size;
+            sum += type_layout(f.type, a) * f.count;
+        }
+        snprintf(buf, sizeof(buf), "\n\t/* size: %d, cachelines: %d, members: %d */\n", info.size, (info.size + 63) / 64, (int)info.fields.size());
+        out += buf;
+        snprintf(buf, sizeof(buf), "\t/* sum members: %d, holes: %d, sum holes: %d */\n", sum, holes, hole_bytes);
+        out += buf;
+        if (info.size > offset) {
+            snprintf(buf, sizeof(buf), "\t/* padding: %d */\n", info.size - offset);
+            out += buf;
+        }
+        if (info.reordered) {
+            snprintf(buf, sizeof(buf), "\t/* reordered by /LAYOUT, was %d bytes */\n", info.original_size);
+            out += buf;
+        }
+        out += "};\n\n";
+    }
+    return out;
+}
+
+static unsigned long long wire_hash(string s) {
+    unsigned long long h = 0xcbf29ce484222325ull;
+    for(auto c: s) h = (h ^ (unsigned char)c) * 0x100000001b3ull;
+    return h;
+}
+
+// wire struct: packed and little-endian, read in place from a file or network buffer.
+// Every field gets Type_get_<field>()/Type_set_<field>() (bounds checked for arrays), and
+// Type_view()/Type_edit() turn a buffer into a record pointer after checking its length.
+static string wire_accessors(string tname, StructInfo& info, string& err) {
+    if (!info.simple || !info.size) {
+        err = "wire struct '" + tname + "' can only have plain fields of fixed-size types";
+        return "";
+    }
+    const char* types[][3] = {{"u8", "", "u8"}, {"i8", "", "i8"}, {"s8", "", "i8"}, {"char", "", "char"}, {"u16", "au_le16", "u16"}, {"i16", "au_le16", "i16"}, {"s16", "au_le16", "i16"}, {"short", "au_le16", "i16"}, {"u32", "au_le32", "u32"}, {"i32", "au_le32", "i32"}, {"s32", "au_le32", "i32"}, {"int", "au_le32", "i32"}, {"bool", "au_le32", "bool"}, {"u64", "au_le64", "u64"}, {"i64", "au_le64", "i64"}, {"s64", "au_le64", "i64"}, {"f16", "au_lef16", "f16"}, {"f32", "au_lef32", "f32"}, {"float", "au_lef32", "f32"}, {"f64", "au_lef64", "f64"}, {"double", "au_lef64", "f64"}, {0, 0, 0}};
+    const char* casts[] = {"au_le16", "u16", "au_le32", "u32", "au_le64", "u64", 0};
+    string schema, out;
+    for(auto& f: info.fields) {
+        string t = f.type, swap, canon;
+        bool known = false;
+        for(int i=0;types[i][0];i++) {
+            if (t != types[i][0]) continue;
+            swap = types[i][1];
+            canon = types[i][2];
+            known = true;
+        }
+        auto nested = global_structs.find(t);
+        bool isNested = !known && nested != global_structs.end() && nested->second.isWire;
+        if (!known && !isNested) {
+            err = "wire struct field '" + f.name + "' has type '" + t + "', which has no fixed wire layout";
+            return "";
+        }
+        if (isNested) {
+            char h[32];
+            snprintf(h, sizeof(h), "#%016llx", nested->second.wireHash);
+            canon = t + h;
+        }
+        schema += canon + " " + f.name + "[" + to_string(f.count) + "];";
+        string get = "m->" + f.name + (f.count > 1 ? "[i]" : "");
+        string set = "v";
+        string ut;
+        for(int i=0;casts[i];i+=2) {
+            if (swap == casts[i]) ut = casts[i+1];
+        }
+        if (ut.size()) {
+            get = "(" + t + ")" + swap + "((" + ut + ")" + get + ")";
+            set = "(" + t + ")" + swap + "((" + ut + ")v)";
+        } else if (swap.size()) {
+            get = swap + "(" + get + ")";
+            set = swap + "(v)";
+        }
+        string fn = tname + "_get_" + f.name, sn = tname + "_set_" + f.name;
+        if (isNested && f.count > 1) {
+            out += "static inline const " + t + "* " + fn + "(const " + tname + "* m, u64 i) {return i < " + to_string(f.count) + " ? &m->" + f.name + "[i] : 0;}\n";
+        } else if (isNested) {
+            out += "static inline const " + t + "* " + fn + "(const " + tname + "* m) {return &m->" + f.name + ";}\n";
+        } else if (f.count > 1) {
+            out += "static inline " + t + " " + fn + "(const " + tname + "* m, u64 i) {return i < " + to_string(f.count) + " ? " + get + " : 0;}\n";
+            out += "static inline void " + sn + "(" + tname + "* m, u64 i, " + t + " v) {if (i < " + to_string(f.count) + ") m->" + f.name + "[i] = " + set + ";}\n";
+        } else {
+            out += "static inline " + t + " " + fn + "(const " + tname + "* m) {return " + get + ";}\n";
+            out += "static inline void " + sn + "(" + tname + "* m, " + t + " v) {m->" + f.name + " = " + set + ";}\n";
+        }
+    }
+    // the hash covers field types, names and counts, so a reader can reject a buffer written with another layout
+    char hash[64];
+    info.wireHash = wire_hash(schema);
+    snprintf(hash, sizeof(hash), "0x%016llxull", info.wireHash);
+    string head = "#define " + tname + "_WIRE_HASH " + hash + "\n";
+    head += "_Static_assert(sizeof(" + tname + ") == " + to_string(info.size) + ", \"wire struct " + tname + " doesn't have its wire size\");\n";
+    head += "static inline const " + tname + "* " + tname + "_view(const void* buf, u64 len, u64 index) {return index < len / sizeof(" + tname + ") ? (const " + tname + "*)buf + index : 0;}\n";
+    head += "static inline " + tname + "* " + tname + "_edit(void* buf, u64 len, u64 index) {return index < len / sizeof(" + tname + ") ? (" + tname + "*)buf + index : 0;}\n";
+    return head + out;
+}
+
+// persistent struct: pointer fields are stored as au_rel self-relative offsets, so a heap of
+// these can be mapped from a file at any address. T_get_<field>/T_set_<field> convert, T_open()
+// maps a file whose root object is a T, new(root) U(...) allocates inside that heap.
+static string persistent_accessors(string tname, StructInfo& info, string& err) {
+    string schema, out;
+    if (!info.simple) {
+        err = "persistent struct '" + tname + "' can only have plain fields";
+        return "";
+    }
+    for(auto& f: info.fields) {
+        schema += f.type + " " + f.name + "[" + to_string(f.count) + "];";
+        bool ptr = f.type.size() && f.type[f.type.size()-1] == '*';
+        auto nested = global_structs.find(f.type);
+        if (!ptr && nested != global_structs.end() && !nested->second.isPersistent) {
+            for(auto& n: nested->second.fields) {
+                if (n.type.size() && n.type[n.type.size()-1] == '*') {
+                    err = "field '" + f.name + "' of persistent struct '" + tname + "' is a '" + f.type + "', which holds raw pointers";
+                    return "";
+                }
+            }
+        }
+        if (!ptr) continue;
+        string fn = tname + "_get_" + f.name, sn = tname + "_set_" + f.name;
+        if (f.count > 1) {
+            out += "static inline " + f.type + " " + fn + "(const " + tname + "* m, u64 i) {return i < " + to_string(f.count) + " ? (" + f.type + ")au_rel_get(&m->" + f.name + "[i]) : 0;}\n";
+            out += "static inline void " + sn + "(" + tname + "* m, u64 i, " + f.type + " p) {if (i < " + to_string(f.count) + ") au_rel_set(&m->" + f.name + "[i], p);}\n";
+        } else {
+            out += "static inline " + f.type + " " + fn + "(const " + tname + "* m) {return (" + f.type + ")au_rel_get(&m->" + f.name + ");}\n";
+            out += "static inline void " + sn + "(" + tname + "* m, " + f.type + " p) {au_rel_set(&m->" + f.name + ", p);}\n";
+        }
+    }
+    char hash[64];
+    snprintf(hash, sizeof(hash), "0x%016llxull", wire_hash(schema));
+    string head = "#define " + tname + "_PERSIST_HASH " + hash + "\n";
+    head += "static inline " + tname + "* " + tname + "_open(const char* path) {return (" + tname + "*)au_pheap_open(path, sizeof(" + tname + "), " + tname + "_PERSIST_HASH);}\n";
+    head += "static inline int " + tname + "_commit(" + tname + "* this) {return au_pheap_commit(this);}\n";
+    head += "static inline void " + tname + "_close(" + tname + "* this) {au_pheap_close(this);}\n";
+    return head + out;
+}
+
+static string soa_container(string tname, StructInfo& info) {
+    string soa = tname + "SoA";
+    string out = "typedef struct " + soa + " {\n\tu64 count, capacity;\n";
+    for(auto& f: info.fields) {
+        if (f.count > 1) out += "\t" + f.type + " (* restrict " + f.name + ")[" + to_string(f.count) + "];\n";
+        else out += "\t" + f.type + "* restrict " + f.name + ";\n";
+    }
+    out += "} " + soa + ";\n";
+    out += "static inline " + soa + "* " + soa + "_new(" + soa + "* this) {\n";
+    out += "\tif (!this) this = malloc(sizeof(" + soa + "));\n";
+    out += "\tmemset(this, 0, sizeof(" + soa + "));\n\treturn this;\n}\n";
+    out += "static inline void " + soa + "_delete(" + soa + "* this) {\n";
+    for(auto& f: info.fields) out += "\tfree(this->" + f.name + ");\n";
+    out += "\tmemset(this, 0, sizeof(" + soa + "));\n}\n";
+    out += "static inline void " + soa + "_reserve(" + soa + "* this, u64 capacity) {\n";
+    out += "\tif (capacity <= this->capacity) return;\n";
+    out += "\tif (capacity < this->capacity * 2) capacity = this->capacity * 2;\n";
+    out += "\tif (capacity < 16) capacity = 16;\n";
+    for(auto& f: info.fields) {
+        out += "\tvoid* au_" + f.name + " = realloc(this->" + f.name + ", capacity * sizeof(*this->" + f.name + "));\n";
+        out += "\tif (!au_" + f.name + ") abort();\n";
+        out += "\tthis->" + f.name + " = au_" + f.name + ";\n";
+    }
+    out += "\tthis->capacity = capacity;\n}\n";
+    out += "static inline void " + soa + "_clear(" + soa + "* this) {\n\tthis->count = 0;\n}\n";
+    out += "static inline void " + soa + "_set(" + soa + "* this, u64 i, " + tname + " v) {\n";
+    for(auto& f: info.fields) {
+        if (f.count > 1) out += "\tmemcpy(this->" + f.name + "[i], v." + f.name + ", sizeof(v." + f.name + "));\n";
+        else out += "\tthis->" + f.name + "[i] = v." + f.name + ";\n";
+    }
+    out += "}\n";
+    out += "static inline " + tname + " " + soa + "_get(" + soa + "* this, u64 i) {\n\t" + tname + " v;\n";
+    for(auto& f: info.fields) {
+        if (f.count > 1) out += "\tmemcpy(v." + f.name + ", this->" + f.name + "[i], sizeof(v." + f.name + "));\n";
+        else out += "\tv." + f.name + " = this->" + f.name + "[i];\n";
+    }
+    out += "\treturn v;\n}\n";
+    out += "static inline u64 " + soa + "_push(" + soa + "* this, " + tname + " v) {\n";
+    out += "\tif (this->count == this->capacity) " + soa + "_reserve(this, this->count + 1);\n";
+    out += "\t" + soa + "_set(this, this->count, v);\n\treturn this->count++;\n}\n";
+    out += "static inline void " + soa + "_remove(" + soa + "* this, u64 i) {\n";
+    out += "\tif (i >= this->count) return;\n";
+    out += "\tthis->count--;\n";
+    out += "\tif (i != this->count) " + soa + "_set(this, i, " + soa + "_get(this, this->count));\n}\n";
+    return out;
+}
+
+static void rewrite_structs(string& code, string& head, string& public_head, vector<string>& public_csv, string& local_head, string& tail, string space, int* outputToHeader, int isPacked, int alignment, int isPublic, int isOpaque, int isPrivate, map<string,int>& symbol_flags, string& struct_name) {
     int isStruct = (code.find("struct") == 0);
     int isClass = (code.find("class") == 0);
     if (!isStruct && !isClass) return;
@@ -184,10 +594,22 @@ static void rewrite_structs(string& code, string& head, string& public_head, vec
         code = code.substr(1);
     }
     symbol_flags[tname] |= 2;
+    struct_name = tname;
+    global_structs[tname].fields.clear();
+    global_structs[tname].simple = true;
+    global_structs[tname].isPacked = isPacked;
+    global_structs[tname].align = alignment;
+    global_structs[tname].size = 0;
+    global_structs[tname].original_size = 0;
+    global_structs[tname].reordered = false;
+    global_structs[tname].inHeader = !isPrivate && !isOpaque;
+    global_structs[tname].isWire = false;
+    global_structs[tname].isPersistent = false;
+    string aligned = alignment ? "AU_ALIGNED(" + to_string(alignment) + ") " : "";
     if (isPrivate) {
         symbol_flags[tname] |= 16;
         local_head += "typedef struct " + tname + " " + tname + ";\n";
-        code = "struct " + tname + " " + code;
+        code = "struct " + aligned + tname + " " + code;
         tail = space + "};";
     } else if (isOpaque) {
         *outputToHeader = 3;
@@ -198,15 +620,15 @@ static void rewrite_structs(string& code, string& head, string& public_head, vec
             public_csv.push_back("\x01unsafe struct "+tname+" {\n");
             public_csv.push_back("\t}\n");
         }
-        code = "typedef struct " + tname + " {";
+        code = "typedef struct " + aligned + tname + " {";
         tail = space + "} " + tname + ";";
     } else if (isPublic) {
         *outputToHeader = 1;
-        code = "typedef struct " + tname + " {";
+        code = "typedef struct " + aligned + tname + " {";
         tail = space + "} " + tname + ";";
     } else {
         *outputToHeader = 2;
-        code = "typedef struct " + tname + " {";
+        code = "typedef struct " + aligned + tname + " {";
         tail = space + "} " + tname + ";";
     }
     if (isPacked) {
@@ -365,6 +787,33 @@ static string read_symbol(string line, int pos) {
     return o;
 }
 
+static bool cs_value_struct(string name);
+
+// C# type of a field in a value-type mirror, empty if it has none with the same layout.
+// f16 fields are ushort bits: Half can't be a fixed buffer element
+static string cs_field_type(StructField& f) {
+    string t = f.type;
+    if (t.size() && t[t.size()-1] == '*') return (f.count == 1) ? "IntPtr" : "";
+    if (global_symbol_flags[t] & 64) return "uint";
+    const char* prims[][2] = {{"u8", "byte"}, {"i8", "sbyte"}, {"s8", "sbyte"}, {"char", "byte"}, {"u16", "ushort"}, {"i16", "short"}, {"s16", "short"}, {"short", "short"}, {"f16", "ushort"}, {"u32", "uint"}, {"i32", "int"}, {"s32", "int"}, {"int", "int"}, {"bool", "int"}, {"f32", "float"}, {"float", "float"}, {"u64", "ulong"}, {"i64", "long"}, {"s64", "long"}, {"f64", "double"}, {"double", "double"}, {0, 0}};
+    for(int i=0;prims[i][0];i++) {
+        if (t == prims[i][0]) return prims[i][1];
+    }
+    if (f.count == 1 && cs_value_struct(t)) return t;
+    return "";
+}
+
+// public structs made only of such fields are mirrored as C# structs instead of handle classes
+static bool cs_value_struct(string name) {
+    auto it = global_structs.find(name);
+    if (it == global_structs.end() || !it->second.simple || !it->second.size || !it->second.fields.size()) return false;
+    if (global_symbol_flags[name] & 32) return false;
+    for(auto& f: it->second.fields) {
+        if (f.isolated || !cs_field_type(f).size()) return false;
+    }
+    return true;
+}
+
 static string translate_type(string type, int opaqueLevel, bool& unsafed, string parent) {
     string t = trim(type);
     bool isConst = type.find("const ") == 0;
@@ -408,8 +857,7 @@ static string translate_type(string type, int opaqueLevel, bool& unsafed, string
             else if (t == "i8") t = "sbyte";
             else if (t == "f64") t = "double";
             else if (t == "f32") t = "float";
-            else if (t == "f16") t = "ushort";
-            else if (t == "f16") t = "ushort";
+            else if (t == "f16") t = "Half";
             if (ptr) {
                 t = "ref " + t;
             }
@@ -418,6 +866,26 @@ static string translate_type(string type, int opaqueLevel, bool& unsafed, string
     return t;
 }
 
+// _Float16 travels in XMM registers but C# Half (a struct) in integer ones, so an f16 passed
+// or returned by value needs a shim to cross into C#; behind a pointer it's just two bytes
+static bool f16_by_value(string sig) {
+    auto lpar = sig.find('('), rpar = sig.rfind(')');
+    if (lpar == string::npos || rpar == string::npos) return false;
+    vector<string> parts;
+    parts.push_back(sig.substr(0, lpar));
+    string list = sig.substr(lpar + 1, rpar - lpar - 1) + ",";
+    for(size_t at = 0, comma; (comma = list.find(',', at)) != string::npos; at = comma + 1) {
+        parts.push_back(list.substr(at, comma - at));
+    }
+    for(auto p: parts) {
+        if (p.find('*') != string::npos || p.find('[') != string::npos) continue;
+        set<string> ids;
+        collect_identifiers(p, ids);
+        if (ids.count("f16")) return true;
+    }
+    return false;
+}
+
 static string extract_entry_point(string sig) {
     auto lpar = sig.find('(');
     if (lpar == string::npos) return "";
@@ -496,7 +964,8 @@ static string replace_argument_types(string sig, int opaqueLevel) {
             if (atype.size() && atype[atype.size()-1] == '*') {
                 atype = trim(atype.substr(0, atype.size() - 1));
             }
-            rsig += "[MarshalAs(UnmanagedType.Struct)] this " + atype + " this_";
+            if (cs_value_struct(parent)) rsig += "this ref " + parent + " this_";
+            else rsig += "[MarshalAs(UnmanagedType.Struct)] this " + atype + " this_";
         } else {
             rsig += translate_type(atype, opaqueLevel, unsafed, i ? "" : parent) + " " + aname;
         }
@@ -506,14 +975,239 @@ static string replace_argument_types(string sig, int opaqueLevel) {
     return rsig;
 }
 
+// /CSFAST parameter types: only what crosses the boundary without a marshalling stub
+static string blittable_type(string type, bool& ok, bool& utf8) {
+    string t = trim(type);
+    bool isConst = t.find("const ") == 0;
+    if (isConst) t = trim(t.substr(5));
+    t = trim(str_replace(str_replace(t, "restrict ", ""), " restrict", ""));
+    bool ptr = t.size() && t[t.size()-1] == '*';
+    if (ptr) t = trim(t.substr(0, t.size()-1));
+    utf8 = false;
+    if (!t.size() || (t == "void" && !ptr)) return "void";
+    int flags = global_symbol_flags[t];
+    if (ptr && t == "void") return "IntPtr";
+    if (ptr && t == "char") {
+        utf8 = isConst;
+        return "byte*";
+    }
+    if (flags & 64) return ptr ? "uint*" : "uint";
+    if (flags & 32) {
+        if (!ptr) ok = false;
+        return t + "*";
+    }
+    const char* prims[][2] = {{"u32", "uint"}, {"i32", "int"}, {"u64", "ulong"}, {"i64", "long"}, {"u16", "ushort"}, {"i16", "short"}, {"u8", "byte"}, {"i8", "sbyte"}, {"f64", "double"}, {"f32", "float"}, {"f16", "Half"}, {"bool", "int"}, {"char", "byte"}, {"int", "int"}, {0, 0}};
+    for(int i=0;prims[i][0];i++) {
+        if (t == prims[i][0]) return string(prims[i][1]) + (ptr ? "*" : "");
+    }
+    if (ptr && cs_value_struct(t)) return t + "*";
+    if (!ptr && cs_value_struct(t)) return t;
+    if (ptr && global_structs.count(t)) return "IntPtr";
+    ok = false;
+    return t;
+}
+
+// /CSFAST: a delegate* unmanaged resolved once from the library, called directly without a
+// marshalling stub; 'fast' functions also skip the GC transition
+static string translate_fast_binding(string spec) {
+    bool fast = spec[0] == 'F';
+    int level = spec[1] - '0';
+    string sig = spec.substr(2);
+    string classic = "\t[DllImport(\""+strip_filename(output)+systag+"\", CharSet = CharSet.Ansi, EntryPoint = \""+extract_entry_point(sig)+"\")]\n\textern public static "+replace_argument_types(sig, level);
+    if (fast) classic = "\t[SuppressGCTransition]\n" + classic;
+    auto lpar = sig.find('(');
+    auto rpar = sig.find(')', lpar);
+    if (lpar == string::npos || rpar == string::npos) return classic;
+    string func = read_symbol_backwards(sig, lpar);
+    string rtype = trim(sig.substr(0, lpar - func.size()));
+    vector<string> args;
+    string buf = trim(sig.substr(lpar + 1, rpar - lpar - 1));
+    while (buf.size()) {
+        auto comma = buf.find(',');
+        args.push_back(trim(buf.substr(0, comma)));
+        buf = (comma == string::npos) ? "" : trim(buf.substr(comma + 1));
+    }
+    if (args.size() == 1 && args[0] == "void") args.clear();
+    string parent = global_symbol_parent[func];
+    string name = func;
+    bool method = parent.size() && func.size() > parent.size() && !(global_symbol_flags[parent] & 32) && args.size() && trim_type(args[0].substr(0, args[0].rfind(' '))) == parent + "*";
+    bool by_ref = method && cs_value_struct(parent);
+    if (parent.size() && func.size() > parent.size() && (level & 1) == 0) name = func.substr(parent.size() + 1);
+    bool ok = true, utf8 = false;
+    string ret = blittable_type(rtype, ok, utf8);
+    string ptypes, params, span_params, call, span_call, fixeds;
+    for(int i=0;i<args.size();i++) {
+        string arg = args[i];
+        auto sp = arg.rfind(' ');
+        string aname = (sp == string::npos) ? "a" + to_string(i) : trim(arg.substr(sp));
+        string atype = (sp == string::npos) ? arg : arg.substr(0, sp);
+        while (aname.size() && aname[0] == '*') {
+            atype += "*";
+            aname = aname.substr(1);
+        }
+        if (aname == "this") aname = "self";
+        const char* keywords[] = {"out", "ref", "in", "params", "base", "object", "string", "event", "lock", "fixed", "checked", "operator", "delegate", "decimal", "internal", "namespace", "readonly", "override", "virtual", 0};
+        for(int k=0;keywords[k];k++) {
+            if (aname == keywords[k]) aname = "@" + aname;
+        }
+        string t = blittable_type(atype, ok, utf8);
+        ptypes += t + ", ";
+        if (i) {
+            params += ", ";
+            span_params += ", ";
+            call += ", ";
+            span_call += ", ";
+        }
+        if (!i && by_ref) {
+            params += "this ref " + parent + " self";
+            span_params += "this ref " + parent + " self";
+            call += "self_p";
+            span_call += "self_p";
+            continue;
+        }
+        if (!i && method) {
+            params += "this " + parent + " self";
+            span_params += "this " + parent + " self";
+            call += "self.handle";
+            span_call += "self.handle";
+            continue;
+        }
+        params += t + " " + aname;
+        call += aname;
+        if (utf8) {
+            span_params += "ReadOnlySpan<byte> " + aname;
+            span_call += aname + "_p";
+            fixeds += "fixed (byte* " + aname + "_p = " + aname + ") ";
+        } else {
+            span_params += t + " " + aname;
+            span_call += aname;
+        }
+    }
+    if (!ok) return classic;
+    string conv = fast ? "unmanaged[Cdecl, SuppressGCTransition]" : "unmanaged[Cdecl]";
+    string fptr = "delegate* " + conv + "<" + ptypes + ret + ">";
+    string out = "\tstatic readonly " + fptr + " au_" + func + " = (" + fptr + ")NativeLibrary.GetExport(au_lib, \"" + func + "\");\n";
+    string pin = by_ref ? "fixed (" + parent + "* self_p = &self) " : "";
+    if (pin.size()) out += "\tpublic static " + ret + " " + name + "(" + params + ") {" + pin + (ret == "void" ? "" : "return ") + "au_" + func + "(" + call + ");}\n";
+    else out += "\tpublic static " + ret + " " + name + "(" + params + ") => au_" + func + "(" + call + ");\n";
+    if (fixeds.size()) {
+        out += "\tpublic static " + ret + " " + name + "(" + span_params + ") {" + pin + fixeds + (ret == "void" ? "" : "return ") + "au_" + func + "(" + span_call + ");}\n";
+    }
+    return out;
+}
+
+// public functions with f16 parameters or results by value reach C# through a shim that trades
+// the u16 bits instead; named <struct>_au_f16_<method> so the C# side drops the prefix as usual
+static string f16_shim_name(string entry) {
+    string parent = global_symbol_parent[entry];
+    if (parent.size() && entry.size() > parent.size()) return parent + "_au_f16_" + entry.substr(parent.size() + 1);
+    return "au_f16_" + entry;
+}
+
+static string f16_as_bits(string decl) {
+    for(size_t at = decl.find("f16"); at != string::npos; at = decl.find("f16", at + 3)) {
+        if (at && (isalnum(decl[at-1]) || decl[at-1] == '_')) continue;
+        if (at + 3 < decl.size() && (isalnum(decl[at+3]) || decl[at+3] == '_')) continue;
+        decl[0 + at] = 'u';
+    }
+    return decl;
+}
+
+// returns the shim's definition, shim_sig gets its head
+static string f16_shim(string sig, string& shim_sig) {
+    auto lpar = sig.find('('), rpar = sig.rfind(')');
+    string entry = read_symbol_backwards(sig, lpar);
+    string rtype = trim(sig.substr(0, lpar - entry.size()));
+    string name = f16_shim_name(entry);
+    global_symbol_parent[name] = global_symbol_parent[entry];
+    string params, args;
+    string list = trim(sig.substr(lpar + 1, rpar - lpar - 1));
+    if (list == "void") list = "";
+    list += ",";
+    for(size_t at = 0, comma; (comma = list.find(',', at)) != string::npos; at = comma + 1) {
+        string p = trim(list.substr(at, comma - at));
+        if (!p.size()) continue;
+        string pname = read_symbol_backwards(p, p.size());
+        bool half = f16_by_value("(" + p + ")");
+        if (params.size()) {
+            params += ", ";
+            args += ", ";
+        }
+        params += half ? f16_as_bits(p) : p;
+        args += half ? "f16_from_bits(" + pname + ")" : pname;
+    }
+    bool half = f16_by_value(rtype + "()");
+    shim_sig = (half ? f16_as_bits(rtype) : rtype) + " " + name + "(" + params + ")";
+    string call = entry + "(" + args + ")";
+    if (rtype == "void") call += ";";
+    else call = "return " + (half ? "f16_bits(" + call + ")" : call) + ";";
+    return "DLLEXPORT " + shim_sig + " {\n\t" + call + "\n}\n";
+}
+
+// the C# method keeps Half in its signature and converts around the shim
+static string translate_f16_binding(string sig) {
+    string shim_sig;
+    f16_shim(sig, shim_sig);
+    string ext = replace_argument_types(shim_sig, 2);
+    string out = "\t[DllImport(\""+strip_filename(output)+systag+"\", CharSet = CharSet.Ansi, EntryPoint = \""+f16_shim_name(extract_entry_point(sig))+"\")]\n";
+    out += "\textern static " + ext;
+    string pub = trim(replace_argument_types(sig, 2));
+    pub = trim(pub.substr(0, pub.rfind(';')));
+    auto lpar = pub.find('('), rpar = pub.rfind(')');
+    string name = read_symbol_backwards(pub, lpar);
+    string ret = trim(pub.substr(0, lpar - name.size()));
+    ret = ret.substr(ret.rfind(' ') == string::npos ? 0 : ret.rfind(' ') + 1);
+    string args, list = pub.substr(lpar + 1, rpar - lpar - 1) + ",";
+    int depth = 0;
+    string p;
+    for(auto c: list) {
+        if (c == '(') depth++;
+        if (c == ')') depth--;
+        if (c != ',' || depth) {
+            p += c;
+            continue;
+        }
+        p = trim(p);
+        if (!p.size()) continue;
+        string pname = read_symbol_backwards(p, p.size());
+        string ptype = trim(p.substr(0, p.size() - pname.size()));
+        ptype = ptype.substr(ptype.rfind(' ') == string::npos ? 0 : ptype.rfind(' ') + 1);
+        if (args.size()) args += ", ";
+        if ((" " + p).find(" ref ") != string::npos) args += "ref " + pname;
+        else if (ptype == "Half") args += "BitConverter.HalfToUInt16Bits(" + pname + ")";
+        else args += pname;
+        p = "";
+    }
+    string call = read_symbol_backwards(ext, ext.find('(')) + "(" + args + ")";
+    if (ret == "Half") call = "BitConverter.UInt16BitsToHalf(" + call + ")";
+    return out + "\tpublic static " + pub + " => " + call + ";\n";
+}
+
 static bool enum_mode = false;
+static bool value_struct_mode = false;
 static string translate_to_cs(string line) {
     string tline = trim(line);
+    if (value_struct_mode) {
+        // the fields were written from the parsed layout with the struct head
+        if (tline.find("}") != 0) return "";
+        value_struct_mode = false;
+        return "\t}\n";
+    }
     bool isUnsafe = false;
     if (tline.find("unsafe ") == 0) {
         isUnsafe = true;
         tline = trim(tline.substr(6));
     }
+    string pack = "#pragma pack(push, 1)";
+    if (tline.find(pack) == 0) tline = trim(tline.substr(pack.size()));
+    string isolated = "struct AU_ALIGNED(AU_CACHELINE) { ";
+    if (tline.find(isolated) == 0 && tline.rfind(" };") == tline.size() - 3) {
+        tline = tline.substr(isolated.size(), tline.size() - 3 - isolated.size());
+    }
+    auto aligned = tline.find("AU_ALIGNED(");
+    if (aligned != string::npos && tline.find(')', aligned) != string::npos) {
+        tline = trim(tline.substr(0, aligned) + tline.substr(tline.find(')', aligned) + 1));
+    }
     tline = str_replace(tline, "typedef ", "");
     tline = str_replace(tline, "struct", "public class");
     tline = str_replace(tline, "enum", "public enum");
@@ -532,6 +1226,28 @@ static string translate_to_cs(string line) {
         indent = "\t\t";
     } else if (!tline.find("public class ")) {
         string out, cls = read_symbol(trim(tline.substr(13)), 0);
+        if (cs_value_struct(cls)) {
+            // same layout as the C struct, so native arrays can be viewed as Span<cls> without copying
+            StructInfo& info = global_structs[cls];
+            string fields;
+            bool fixeds = false;
+            for(auto& f: info.fields) {
+                string t = cs_field_type(f);
+                if (f.count > 1) {
+                    fields += "\t\tpublic fixed " + t + " " + f.name + "[" + to_string(f.count) + "];\n";
+                    fixeds = true;
+                } else {
+                    fields += "\t\tpublic " + t + " " + f.name + ";\n";
+                }
+            }
+            out += "\t[StructLayout(LayoutKind.Sequential";
+            if (info.isPacked) out += ", Pack = 1";
+            if (global_symbol_flags[cls] & 256) out += ", Size = " + to_string(info.size);
+            out += ")]\n";
+            out += string("\tpublic ") + (fixeds ? "unsafe " : "") + "struct " + cls + " {\n" + fields;
+            value_struct_mode = true;
+            return out;
+        }
         int hasCtor = global_symbol_parent[cls+"_new"].size();
         if (hasCtor) {
             string ctorArgs = global_symbol_sig[cls+"_new"];
@@ -551,11 +1267,16 @@ static string translate_to_cs(string line) {
             //out += "\textern private static void "+cls+"_delete([MarshalAs(UnmanagedType.Struct)] this "+cls+" this_);\n";
             out += "\textern private static void "+cls+"_delete(IntPtr handle);\n";
         }
-        out += "\t[StructLayout(LayoutKind.Sequential)]\n\t";
+        auto layout = global_structs.find(cls);
+        if (layout != global_structs.end() && layout->second.size && (global_symbol_flags[cls] & 256)) {
+            out += "\t[StructLayout(LayoutKind.Sequential, Size = " + to_string(layout->second.size) + ")]\n\t";
+        } else {
+            out += "\t[StructLayout(LayoutKind.Sequential)]\n\t";
+        }
         if (isUnsafe) out += "unsafe ";
         //out += tline+"\n";
         out += "\tpublic class "+cls+" {\n";
-        out += "\t\tIntPtr handle;\n";
+        out += csfast_mode ? "\t\tinternal IntPtr handle;\n" : "\t\tIntPtr handle;\n";
         if (hasCtor) out += "\t\tpublic "+cls+"() {handle = "+cls+"_new(new IntPtr(0));}\n";
         if (hasDtor) out += "\t\t~"+cls+"() {"+cls+"_delete(handle);}\n";
         return out;
@@ -563,7 +1284,7 @@ static string translate_to_cs(string line) {
     return indent+tline+"\n";
 }
 
-static int extract_public_signatures(string& head, string& post_head, string& public_post_head, vector<string>& public_csv, string& local_post_head, string& local_head, string& line, int isPacked, int isPublic, int isPrivate, int isOpaque) {
+static int extract_public_signatures(string& head, string& post_head, string& public_post_head, vector<string>& public_csv, string& local_post_head, string& local_head, string& line, int isPacked, int isPublic, int isPrivate, int isOpaque, int isFast) {
     string space, code;
     int trigger = 0;
     for(auto c: line) {
@@ -597,7 +1318,12 @@ static int extract_public_signatures(string& head, string& post_head, string& pu
             lentry = entry.substr(par.size() + 1);
         }
         if (isPublic) {
-            if (lentry != "new" && lentry != "delete") {
+            if (lentry != "new" && lentry != "delete" && f16_by_value(hcode)) {
+                public_csv.push_back("\x04" + hcode);
+            } else if (lentry != "new" && lentry != "delete" && csfast_mode) {
+                public_csv.push_back(string("\x03") + (isFast ? "F2" : "-2") + hcode);
+            } else if (lentry != "new" && lentry != "delete") {
+                if (isFast) public_csv.push_back("\t[SuppressGCTransition]\n");
                 public_csv.push_back("\t[DllImport(\""+strip_filename(output)+systag+"\", CharSet = CharSet.Ansi, EntryPoint = \""+entry+"\")]\n");
                 public_csv.push_back("\textern public static "+replace_argument_types(hcode, 2));
             }
@@ -606,7 +1332,10 @@ static int extract_public_signatures(string& head, string& post_head, string& pu
             //local_post_head += "DLLEXPORT " + hcode;
             line = space + "DLLEXPORT " + code;
         } else if (isOpaque) {
-            if (lentry != "new" && lentry != "delete") {
+            if (lentry != "new" && lentry != "delete" && csfast_mode) {
+                public_csv.push_back(string("\x03") + (isFast ? "F3" : "-3") + hcode);
+            } else if (lentry != "new" && lentry != "delete") {
+                if (isFast) public_csv.push_back("\t[SuppressGCTransition]\n");
                 public_csv.push_back("\t[DllImport(\""+strip_filename(output)+systag+"\", CharSet = CharSet.Ansi, EntryPoint = \""+entry+"\")]\n");
                 public_csv.push_back("\textern public static "+replace_argument_types(hcode, 3));
             }
@@ -663,7 +1392,13 @@ static string resolve_member_functions(string line, int isHead, int isStatic, in
     auto curly = line.find('\n');
     bool isCtor = !isCustom && !isHead && (func == "new");
     out += line;
-    if (isCtor) out += "\n\tif (!this) this = malloc(sizeof("+type+"));";
+    if (isCtor && (global_symbol_flags[type] & 128)) {
+        out += "\n\tif (!this) this = au_pool_alloc(&"+type+"_pool);";
+    } else if (isCtor && (global_symbol_flags[type] & 256)) {
+        out += "\n\tif (!this) this = au_aligned_alloc(sizeof("+type+"), AU_ALIGNOF("+type+"));";
+    } else if (isCtor) {
+        out += "\n\tif (!this) this = malloc(sizeof("+type+"));";
+    }
     return out;
 }
 
@@ -709,7 +1444,15 @@ static string rewrite_delete(string& code, string type, string name, map<string,
         newcode += "&";
     }
     newcode += name + ");";
-    if (isPtr && !isCustom) {
+    if (isPtr && !isCustom && var_type_table[name+"@arena"].size()) {
+        // arena memory is released in bulk by arena_reset()/arena_delete()
+    } else if (isPtr && !isCustom && var_type_table[name+"@stack"].size()) {
+        // promoted to the stack by stack_candidates(), nothing to free
+    } else if (isPtr && !isCustom && (global_symbol_flags[type] & 128)) {
+        newcode += " au_pool_free(&" + type + "_pool, " + name + ");";
+    } else if (isPtr && !isCustom && (global_symbol_flags[type] & 256)) {
+        newcode += " au_aligned_free(" + name + ");";
+    } else if (isPtr && !isCustom) {
         // FIXME: this is horrible. doing free() here COMPLETELY BREAKS public delete functions using "custom" keyword
         newcode += " free(" + name + ");";
     }
@@ -725,7 +1468,15 @@ static string rewrite_new(string& code, string type, string name, string obuffer
         type = type.substr(0, type.size()-1);
     }
     string newcode = type+"_new(0";
-    auto hack = code.find(obuffer) + obuffer.size();
+    auto at = code.find(obuffer);
+    auto eq = at;
+    while (eq && isspace(code[eq-1])) eq--;
+    if (eq > 1 && code[eq-1] == '=' && !strchr("=!<>", code[eq-2])) {
+        // a plain new replaces whatever arena allocation the variable held
+        string var = read_symbol_backwards(code, eq-1);
+        if (var.size()) var_type_table.erase(var+"@arena");
+    }
+    auto hack = at + obuffer.size();
     while (isspace(code[hack])) hack++;
     if (code[hack] != ')') {
         newcode += ", ";
@@ -734,7 +1485,94 @@ static string rewrite_new(string& code, string type, string name, string obuffer
     return "";
 }
 
-static string extract_variable_types(string& code, map<string, string>& var_type_table, map<string,int>& symbol_flags, bool hasTail) {
+// new(a) Foo(...) -> Foo_new(arena_alloc(a, sizeof(Foo), AU_ALIGNOF(Foo)), ...)
+// code with string/char literals and comments blanked out, same length, for matching keywords
+static string code_only(string code, bool in_comment) {
+    char quote = 0;
+    for(int i=0;i<code.size();i++) {
+        char c = code[i];
+        char n = (i+1 < code.size()) ? code[i+1] : 0;
+        if (in_comment) {
+            code[i] = ' ';
+            if (c == '*' && n == '/') {
+                in_comment = false;
+                code[++i] = ' ';
+            }
+            continue;
+        }
+        if (quote) {
+            code[i] = ' ';
+            if (c == '\\' && i+1 < code.size()) code[++i] = ' ';
+            else if (c == quote) quote = 0;
+            continue;
+        }
+        if (c == '/' && n == '/') {
+            for(;i<code.size();i++) code[i] = ' ';
+            break;
+        }
+        if (c == '/' && n == '*') {
+            in_comment = true;
+            code[i] = code[i+1] = ' ';
+            i++;
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            quote = c;
+            code[i] = ' ';
+        }
+    }
+    return code;
+}
+
+static string rewrite_placement_new(string& code, map<string, string>& var_type_table, bool in_comment) {
+    size_t at = 0;
+    for(;;) {
+        string plain = code_only(code, in_comment);
+        at = plain.find("new", at);
+        if (at == string::npos) break;
+        size_t p = at + 3;
+        if ((at && (isalnum(code[at-1]) || code[at-1] == '_' || code[at-1] == ':' || code[at-1] == '.' || code[at-1] == '>')) || (p < code.size() && (isalnum(code[p]) || code[p] == '_'))) {
+            at = p;
+            continue;
+        }
+        while (p < code.size() && isspace(code[p])) p++;
+        if (p >= code.size() || code[p] != '(') {
+            at = p;
+            continue;
+        }
+        int depth = 0;
+        size_t q = p;
+        for(;q<code.size();q++) {
+            if (plain[q] == '(') depth++;
+            if (plain[q] == ')' && !--depth) break;
+        }
+        if (q >= code.size()) return "unbalanced parentheses in placement new";
+        string pool = trim(code.substr(p+1, q-p-1));
+        size_t t = q + 1;
+        while (t < code.size() && isspace(code[t])) t++;
+        string type;
+        while (t < code.size() && (isalnum(code[t]) || code[t] == '_')) type += code[t++];
+        while (t < code.size() && isspace(code[t])) t++;
+        if (!type.size() || t >= code.size() || code[t] != '(') return "expected constructor call after new(" + pool + ")";
+        size_t a = t + 1;
+        while (a < code.size() && isspace(code[a])) a++;
+        string heap = trim_type(var_type_table[pool]);
+        heap = heap.size() ? heap.substr(0, heap.size() - 1) : heap;
+        bool persistent = global_structs.count(heap) && global_structs[heap].isPersistent;
+        string newcode = type + "_new(" + (persistent ? "au_pheap_alloc(" + pool + ", sizeof(" + type + "))" : "arena_alloc(" + pool + ", sizeof(" + type + "), AU_ALIGNOF(" + type + "))");
+        if (a < code.size() && code[a] != ')') newcode += ", ";
+        auto eq = code.rfind('=', at);
+        if (eq != string::npos && eq && code[eq-1] != '=' && code[eq-1] != '!' && code[eq-1] != '<' && code[eq-1] != '>') {
+            string var = read_symbol_backwards(code, eq);
+            if (var.size()) var_type_table[var+"@arena"] = pool;
+        }
+        code = code.substr(0, at) + newcode + code.substr(a);
+        at += newcode.size();
+    }
+    return "";
+}
+
+static string extract_variable_types(string& code, map<string, string>& var_type_table, map<string,int>& symbol_flags, bool hasTail, set<string>* declared = 0) {
     bool hasCurly = (code.find('{') != string::npos);
     bool done = false;
     while (!done) {
@@ -761,6 +1599,9 @@ static string extract_variable_types(string& code, map<string, string>& var_type
                     } else if (type != "return") {
                         type = trim_type(type);
                         var_type_table[name] = type;
+                        var_type_table.erase(name+"@arena");
+                        var_type_table.erase(name+"@stack");
+                        if (declared) declared->insert(name);
                         symbol_flags[type] |= 4 + 8;
                         if (hasTail) {
                             symbol_flags[type] |= 1;
@@ -802,6 +1643,14 @@ static string extract_variable_types(string& code, map<string, string>& var_type
     return "";
 }
 
+static bool is_vector_type(string t) {
+    const char* vector_types[] = {"i8x16", "u8x16", "i16x8", "u16x8", "i32x4", "u32x4", "i32x8", "u32x8", "i64x2", "u64x2", "i64x4", "u64x4", "f32x4", "f32x8", "f64x2", "f64x4", 0};
+    for(int i=0;vector_types[i];i++) {
+        if (t == vector_types[i]) return true;
+    }
+    return false;
+}
+
 static string rewrite_member_calls(string& code, map<string, string>& var_type_table) {
     size_t l, r = 0;
     for(;;) {
@@ -861,7 +1710,8 @@ static string rewrite_member_calls(string& code, map<string, string>& var_type_t
         if (isPtr && type != "->") return "'" HILITE + obj + REGGS "' is a pointer, use -> for member calls";
         if (!isPtr && type != ".") return "'" HILITE + obj + REGGS "' is not a pointer, use . for member calls";
         string newcode = code.substr(0, l+1) + t + "_" + func + "(";
-        if (isPtr) {
+        if (isPtr || is_vector_type(t)) {
+            // vector types live in registers, so their helpers take them by value
             newcode += obj;
         } else {
             newcode += "&"+obj;
@@ -873,59 +1723,1032 @@ static string rewrite_member_calls(string& code, map<string, string>& var_type_t
     return "";
 }
 
-struct SourceFile {
-    string filename;
-    string head, body, tail;
-    string local_head, post_head, public_post_head, local_post_head, public_head;
-    string public_cs;
-    vector<string> public_csv;
-    string template_class;
-    vector<string> template_vars;
-    vector<string> lines;
-    map<string, string> var_type_table;
-    int outputToHeader;
-    bool valid;
-    bool processed;
-    int rearrangements;
-    bool rebuild;
-    map<string,int> symbol_flags;
-    vector<SourceFile*> exports_to, imports_from;
-    SourceFile(const char* filename_) {
-        valid = false;
-        processed = false;
-        filename = filename_;
-        rearrangements = 0;
-        rebuild = false;
-        FILE*fp = fopen(filename_, "r");
-        if (!fp) return;
-        int line_no = 0;
-        while (!feof(fp)) {
-            string line = "";
-            while (!feof(fp)) {
-                int c = fgetc(fp);
-                if (c == EOF) break;
-                if (c == '\r') continue;
-                if (c == '\n') break;
-                line += (char)c;
+static void count_braces(string code, int& depth, bool& in_comment) {
+    char quote = 0;
+    for(int i=0;i<code.size();i++) {
+        char c = code[i];
+        char n = (i+1 < code.size()) ? code[i+1] : 0;
+        if (in_comment) {
+            if (c == '*' && n == '/') {
+                in_comment = false;
+                i++;
             }
-            line_no++;
-            string l = trim(line);
-            if (l.find("#copyright") == 0) {
-                string cline = trim(l.substr(10));
-                lines.push_back("// Copyright (C) "+cline+"\n");
-                auto clip = cline.find('<');
-                if (clip != string::npos) {
-                    cline = trim(cline.substr(0, clip));
-                }
-                if (copyright.size()) {
-                    copyright += ", ";
-                }
-                copyright += cline;
-                continue;
+            continue;
+        }
+        if (quote) {
+            if (c == '\\') i++;
+            else if (c == quote) quote = 0;
+            continue;
+        }
+        if (c == '/' && n == '/') break;
+        if (c == '/' && n == '*') {
+            in_comment = true;
+            i++;
+            continue;
+        }
+        if (c == '"' || c == '\'') quote = c;
+        if (c == '{') depth++;
+        if (c == '}') depth--;
+    }
+}
+
+static void collect_identifiers(string code, set<string>& out) {
+    string sym;
+    char quote = 0;
+    for(int i=0;i<=code.size();i++) {
+        char c = (i < code.size()) ? code[i] : ' ';
+        if (quote) {
+            if (c == '\\') i++;
+            else if (c == quote) quote = 0;
+            continue;
+        }
+        if (isalnum(c) || c == '_') {
+            sym += c;
+            continue;
+        }
+        if (sym.size() && !isdigit(sym[0])) out.insert(sym);
+        sym = "";
+        if (c == '"' || c == '\'') quote = c;
+    }
+}
+
+// scoped: a parameter or local declared with one of the names shadows it until its block closes
+static string rename_identifiers(string code, map<string, string>& names, bool scoped = false) {
+    string out, sym;
+    char quote = 0;
+    vector<set<string> > scopes(1);
+    set<string> params;
+    int parens = 0;
+    for(int i=0;i<=code.size();i++) {
+        char c = (i < code.size()) ? code[i] : 0;
+        if (quote) {
+            if (c == '\\' && i+1 < code.size()) {
+                out += c;
+                c = code[++i];
+            } else if (c == quote) {
+                quote = 0;
             }
-            if (l.find("#template") == 0) {
-                lines.push_back("");
-                if (template_class.size()) {
+            if (c) out += c;
+            continue;
+        }
+        if (isalnum(c) || c == '_') {
+            sym += c;
+            continue;
+        }
+        if (sym.size()) {
+            auto it = names.find(sym);
+            bool member = false;
+            for(int j=(int)out.size()-1;j>=0;j--) {
+                if (isspace(out[j])) continue;
+                member = (out[j] == '.') || (out[j] == '>' && j && out[j-1] == '-');
+                break;
+            }
+            bool shadowed = false;
+            if (scoped && it != names.end() && !member) {
+                size_t n = i;
+                while (n < code.size() && isspace(code[n])) n++;
+                char next = n < code.size() ? code[n] : 0;
+                int j = (int)out.size() - 1;
+                while (j >= 0 && (isspace(out[j]) || out[j] == '*')) j--;
+                string type = j >= 0 ? read_symbol_backwards(out, j + 1) : "";
+                const char* words[] = {"return", "case", "goto", "sizeof", "else", "do", 0};
+                bool declares = type.size() && !isdigit(type[0]) && (next == '=' || next == ';' || next == ',' || next == ')' || next == '[');
+                for(int w=0;declares && words[w];w++) declares = type != words[w];
+                // at file scope a declaration is the renamed global itself
+                if (declares && parens) params.insert(sym);
+                else if (declares && scopes.size() > 1) scopes.back().insert(sym);
+                for(auto& sc: scopes) shadowed = shadowed || sc.count(sym);
+                shadowed = shadowed || (parens && params.count(sym));
+            }
+            out += (it != names.end() && !member && !shadowed && !isdigit(sym[0])) ? it->second : sym;
+            sym = "";
+        }
+        if (c == '"' || c == '\'') quote = c;
+        if (scoped && !quote) {
+            if (c == '(') parens++;
+            if (c == ')' && parens) parens--;
+            if (c == '{') {
+                scopes.push_back(params);
+                params.clear();
+            }
+            if (c == '}' && scopes.size() > 1) scopes.pop_back();
+            if (c == ';' && !parens) params.clear();
+        }
+        if (c) out += c;
+    }
+    return out;
+}
+
+// "noalias T* p" or "T* noalias p" in a parameter list: the definition gets "T* restrict p",
+// the prototype in the headers (and the C# binding built from it) just drops the word
+static string rewrite_noalias(string& code, string& plain) {
+    auto lpar = code.find('(');
+    int depth = 0;
+    size_t rpar = lpar;
+    for(;rpar<code.size();rpar++) {
+        if (code[rpar] == '(') depth++;
+        if (code[rpar] == ')' && !--depth) break;
+    }
+    if (rpar >= code.size()) return "";
+    string params = code.substr(lpar + 1, rpar - lpar - 1);
+    if (params.find("noalias") == string::npos) return "";
+    string out, out_plain, p;
+    depth = 0;
+    for(int i=0;i<=params.size();i++) {
+        char c = (i < params.size()) ? params[i] : ',';
+        if (c == '(') depth++;
+        if (c == ')') depth--;
+        if (c != ',' || depth) {
+            p += c;
+            continue;
+        }
+        map<string, string> probe;
+        probe["noalias"] = "\x01";
+        string marked = rename_identifiers(p, probe);
+        auto at = marked.find('\x01');
+        if (at != string::npos) {
+            string stripped = marked.substr(0, at) + marked.substr(at + 1);
+            stripped = p.substr(0, p.find_first_not_of(" \t")) + trim(str_replace(stripped, "  ", " "));
+            auto star = stripped.rfind('*');
+            if (star == string::npos) return "noalias needs a pointer parameter: '" + trim(p) + "'";
+            p = stripped.substr(0, star + 1) + " restrict" + stripped.substr(star + 1);
+            out_plain += stripped;
+        } else {
+            out_plain += p;
+        }
+        out += p;
+        if (i < params.size()) {
+            out += ",";
+            out_plain += ",";
+        }
+        p = "";
+    }
+    plain = code.substr(0, lpar + 1) + out_plain + code.substr(rpar);
+    code = code.substr(0, lpar + 1) + out + code.substr(rpar);
+    return "";
+}
+
+static bool is_function_head(string code) {
+    code = trim(code);
+    auto lpar = code.find('(');
+    if (lpar == string::npos || code.find('{') == string::npos) return false;
+    if (code.find(')') == string::npos || code[0] == '#' || code[0] == '}') return false;
+    auto eq = code.find('=');
+    if (eq != string::npos && eq < lpar) return false;
+    string func = read_symbol_backwards(code, lpar);
+    if (!func.size()) return false;
+    const char* keywords[] = {"if", "for", "while", "switch", "return", "sizeof", 0};
+    for(int i=0;keywords[i];i++) {
+        if (func == keywords[i]) return false;
+    }
+    return true;
+}
+
+struct ParallelFor {
+    string header, type, var, start, cmp, bound, step;
+    vector<pair<string, string> > reductions;
+    string schedule, chunk;
+    map<string, string> scope;
+    set<string> declared;
+    string body;
+    int depth, line;
+};
+
+// parallel for (<init>; <var> <cmp> <bound>; <step>) [reduce(<op>: <vars>)]... [schedule(<kind>[, <chunk>])] {
+static string parse_parallel_for(string code, ParallelFor& pf, map<string, string>& var_type_table) {
+    code = trim(code.substr(8));
+    if (code.find("for") != 0) return "expected 'for' after 'parallel'";
+    auto lpar = code.find('(');
+    if (lpar == string::npos || trim(code.substr(3, lpar - 3)).size()) return "expected '(' after 'parallel for'";
+    int depth = 0;
+    size_t rpar = lpar;
+    for(;rpar<code.size();rpar++) {
+        if (code[rpar] == '(') depth++;
+        if (code[rpar] == ')' && !--depth) break;
+    }
+    if (rpar >= code.size()) return "unbalanced parentheses in parallel for";
+    if (code[code.size()-1] != '{') return "parallel for needs its body in braces, starting on the same line";
+    pf.header = code.substr(lpar + 1, rpar - lpar - 1);
+    string clauses = trim(code.substr(rpar + 1, code.size() - rpar - 2));
+    while (clauses.size()) {
+        string name = read_symbol(clauses, 0);
+        auto open = clauses.find('(');
+        auto close = clauses.find(')');
+        if (!name.size() || open == string::npos || close == string::npos || trim(clauses.substr(name.size(), open - name.size())).size()) return "malformed parallel for clause '" + clauses + "'";
+        string args = trim(clauses.substr(open + 1, close - open - 1));
+        clauses = trim(clauses.substr(close + 1));
+        if (name == "reduce") {
+            auto colon = args.find(':');
+            if (colon == string::npos) return "reduce() needs '<op>: <variables>'";
+            string op = trim(args.substr(0, colon));
+            if (op != "+" && op != "-" && op != "*" && op != "&" && op != "|" && op != "^" && op != "&&" && op != "||" && op != "min" && op != "max") return "unsupported reduce operator '" + op + "'";
+            args = args.substr(colon + 1);
+            while (args.size()) {
+                auto comma = args.find(',');
+                string v = trim(args.substr(0, comma));
+                args = (comma == string::npos) ? "" : args.substr(comma + 1);
+                if (v.size()) pf.reductions.push_back(make_pair(op, v));
+            }
+        } else if (name == "schedule") {
+            auto comma = args.find(',');
+            pf.schedule = trim(args.substr(0, comma));
+            pf.chunk = (comma == string::npos) ? "" : trim(args.substr(comma + 1));
+            if (pf.schedule != "static" && pf.schedule != "dynamic" && pf.schedule != "guided" && pf.schedule != "auto") return "unknown schedule '" + pf.schedule + "'";
+        } else {
+            return "unknown parallel for clause '" + name + "'";
+        }
+    }
+    vector<string> parts;
+    string rest = pf.header;
+    for(int i=0;i<2;i++) {
+        auto semi = rest.find(';');
+        if (semi == string::npos) return "parallel for needs '<init>; <condition>; <step>'";
+        parts.push_back(trim(rest.substr(0, semi)));
+        rest = rest.substr(semi + 1);
+    }
+    parts.push_back(trim(rest));
+    auto eq = parts[0].find('=');
+    if (eq == string::npos) return "parallel for needs an initialized loop variable";
+    pf.var = read_symbol_backwards(parts[0], eq);
+    pf.type = trim_type(parts[0].substr(0, parts[0].rfind(pf.var, eq)));
+    if (!pf.type.size()) pf.type = var_type_table[pf.var];
+    if (!pf.type.size()) pf.type = "i64";
+    pf.start = trim(parts[0].substr(eq + 1));
+    const char* cmps[] = {"<=", ">=", "!=", "<", ">", 0};
+    for(int i=0;cmps[i];i++) {
+        auto at = parts[1].find(cmps[i]);
+        if (at == string::npos) continue;
+        if (trim(parts[1].substr(0, at)) != pf.var) return "parallel for condition must compare '" + pf.var + "'";
+        pf.cmp = cmps[i];
+        pf.bound = trim(parts[1].substr(at + strlen(cmps[i])));
+        break;
+    }
+    if (!pf.cmp.size()) return "parallel for condition must be <, <=, >, >= or !=";
+    string step = str_replace(parts[2], " ", "");
+    if (step == pf.var + "++" || step == "++" + pf.var) pf.step = "1";
+    else if (step == pf.var + "--" || step == "--" + pf.var) pf.step = "-1";
+    else if (step.find(pf.var + "+=") == 0) pf.step = "(" + trim(parts[2].substr(parts[2].find("+=") + 2)) + ")";
+    else if (step.find(pf.var + "-=") == 0) pf.step = "-(" + trim(parts[2].substr(parts[2].find("-=") + 2)) + ")";
+    else return "parallel for step must be ++, --, += or -= on '" + pf.var + "'";
+    return "";
+}
+
+static string parallel_for_pragma(ParallelFor& pf) {
+    string out = "#pragma omp parallel for";
+    for(auto& r: pf.reductions) out += " reduction(" + r.first + ":" + r.second + ")";
+    if (pf.schedule.size()) out += " schedule(" + pf.schedule + (pf.chunk.size() ? ", " + pf.chunk : "") + ")";
+    return out;
+}
+
+// /NO-OPENMP: the loop body becomes a static function over [lo, hi) iterations, locals it uses are passed by pointer
+static string outline_parallel_for(ParallelFor& pf, string name, string space, string& local_head, string& outlined, string& call) {
+    set<string> used;
+    map<string, string> probe;
+    for(auto& v: pf.scope) probe[v.first] = "\x01" + v.first + "\x01";
+    string marked = rename_identifiers(pf.body, probe);
+    for(size_t at = marked.find('\x01'); at != string::npos; at = marked.find('\x01', at)) {
+        auto end = marked.find('\x01', at + 1);
+        used.insert(marked.substr(at + 1, end - at - 1));
+        at = end + 1;
+    }
+    set<string> words;
+    collect_identifiers(pf.body, words);
+    if (words.count("return") || words.count("goto")) return "return and goto are not allowed inside a parallel for";
+    map<string, string> renames;
+    map<string, string> reduce_ops;
+    for(auto& r: pf.reductions) {
+        if (!pf.scope[r.second].size()) return "unknown type for reduce variable '" + r.second + "'";
+        reduce_ops[r.second] = r.first;
+    }
+    string ctx = "typedef struct " + name + " {\n";
+    string init = name + " au_ctx = {";
+    for(auto& v: pf.scope) {
+        if (v.first == pf.var || pf.declared.count(v.first)) continue;
+        if (!used.count(v.first) && !reduce_ops.count(v.first)) continue;
+        if (v.first == "this") {
+            ctx += "\t" + v.second + " " + v.first + ";\n";
+            init += v.first + ", ";
+            renames[v.first] = "au_c->" + v.first;
+        } else {
+            ctx += "\t" + v.second + "* " + v.first + ";\n";
+            init += "&" + v.first + ", ";
+            if (!reduce_ops.count(v.first)) renames[v.first] = "(*au_c->" + v.first + ")";
+        }
+    }
+    ctx += "\ti64 start, step;\n";
+    init += "(i64)(" + pf.start + "), " + pf.step;
+    // min/max start from the value before the loop: workers that finish early write the shared
+    // variable under the lock while others are still starting, so it can't be read as the identity
+    for(auto& r: pf.reductions) {
+        if (r.first != "min" && r.first != "max") continue;
+        ctx += "\t" + pf.scope[r.second] + " au_init_" + r.second + ";\n";
+        init += ", " + r.second;
+    }
+    ctx += "} " + name + ";\n";
+    local_head += ctx + "static void " + name + "_body(void* au_ctx, i64 au_lo, i64 au_hi);\n";
+    init += "};";
+    string a = "(i64)(" + pf.start + ")", b = "(i64)(" + pf.bound + ")", st = pf.step;
+    string count;
+    if (pf.cmp == "<") count = "(" + b + " > " + a + " ? (" + b + " - " + a + " + " + st + " - 1) / " + st + " : 0)";
+    if (pf.cmp == "<=") count = "(" + b + " >= " + a + " ? (" + b + " - " + a + ") / " + st + " + 1 : 0)";
+    if (pf.cmp == ">") count = "(" + a + " > " + b + " ? (" + a + " - " + b + " - " + st + " - 1) / (-(" + st + ")) : 0)";
+    if (pf.cmp == ">=") count = "(" + a + " >= " + b + " ? (" + a + " - " + b + ") / (-(" + st + ")) + 1 : 0)";
+    if (pf.cmp == "!=") count = "((" + b + " - " + a + ") / " + st + ")";
+    string grain = "0";
+    if (pf.chunk.size()) grain = pf.chunk;
+    else if (pf.schedule == "static") grain = "-1";
+    else if (pf.schedule == "dynamic") grain = "1";
+    string fn = "static void " + name + "_body(void* au_ctx, i64 au_lo, i64 au_hi) {\n";
+    fn += "\t" + name + "* au_c = (" + name + "*)au_ctx;\n";
+    for(auto& r: pf.reductions) {
+        string identity = "0";
+        if (r.first == "*" || r.first == "&&") identity = "1";
+        if (r.first == "&") identity = "~0";
+        if (r.first == "min" || r.first == "max") identity = "au_c->au_init_" + r.second;
+        fn += "\t" + pf.scope[r.second] + " " + r.second + " = " + identity + ";\n";
+    }
+    fn += "\tfor (i64 au_k = au_lo; au_k < au_hi; au_k++) {\n";
+    fn += "\t\t" + pf.type + " " + pf.var + " = (" + pf.type + ")(au_c->start + au_k * au_c->step);\n";
+    string line;
+    for(auto c: pf.body) {
+        line += c;
+        if (c != '\n') continue;
+        fn += (line[0] == '#') ? line : rename_identifiers(line, renames);
+        line = "";
+    }
+    fn += "\t}\n";
+    if (pf.reductions.size()) {
+        fn += "\tau_parallel_lock();\n";
+        for(auto& r: pf.reductions) {
+            string p = "*au_c->" + r.second;
+            if (r.first == "min") fn += "\tif (" + r.second + " < " + p + ") " + p + " = " + r.second + ";\n";
+            else if (r.first == "max") fn += "\tif (" + r.second + " > " + p + ") " + p + " = " + r.second + ";\n";
+            else if (r.first == "&&" || r.first == "||") fn += "\t" + p + " = " + p + " " + r.first + " " + r.second + ";\n";
+            else if (r.first == "-") fn += "\t" + p + " += " + r.second + ";\n";
+            else fn += "\t" + p + " " + r.first + "= " + r.second + ";\n";
+        }
+        fn += "\tau_parallel_unlock();\n";
+    }
+    fn += "}\n";
+    outlined += fn;
+    call = space + "{\n" + space + "\t" + init + "\n" + space + "\tau_parallel_for(" + count + ", " + grain + ", " + name + "_body, &au_ctx);\n" + space + "}\n";
+    return "";
+}
+
+// a header copy of the body is compiled in every file including the header, so it may only name
+// this->members, parameters, its own locals and keywords: file-level globals (static or not) are
+// declared in the defining file only
+static bool self_contained(string text, set<string> known) {
+    const char* words[] = {"this", "return", "if", "else", "while", "for", "do", "break", "continue", "switch", "case", "default", "sizeof", "true", "false", "NULL", "const", "unsigned", "signed", "long", "void", "char", "short", "int", "float", "double", "bool", "u8", "i8", "s8", "u16", "i16", "s16", "f16", "u32", "i32", "s32", "f32", "u64", "i64", "s64", "f64", 0};
+    set<string> types;
+    for(int i=0;words[i];i++) {
+        known.insert(words[i]);
+        if (i >= 16) types.insert(words[i]);
+    }
+    for(auto& st: global_structs) types.insert(st.first);
+    string sym, last;
+    char quote = 0, prev = 0;
+    for(int i=0;i<=text.size();i++) {
+        char c = (i < text.size()) ? text[i] : ' ';
+        if (quote) {
+            if (c == '\\') i++;
+            else if (c == quote) quote = 0;
+            continue;
+        }
+        if (isalnum(c) || c == '_') {
+            sym += c;
+            continue;
+        }
+        if (sym.size() && !isdigit(sym[0])) {
+            // member names after -> or ., and the variable a type name declares
+            if (types.count(last)) known.insert(sym);
+            if (prev != '.' && prev != '>' && !known.count(sym)) return false;
+            last = sym;
+        }
+        if (sym.size()) prev = 0;
+        sym = "";
+        if (c == '"' || c == '\'') quote = c;
+        if (!isspace(c)) {
+            prev = c;
+            if (c != '*') last = "";
+        }
+    }
+    return true;
+}
+
+// getter-sized bodies: closed within three lines of the head, no calls (new/delete are calls too)
+// and self-contained
+static bool small_function(vector<string>& lines, int index) {
+    int depth = 0;
+    bool in_comment = false;
+    string text;
+    for(int i=index;i<lines.size() && i<=index+4;i++) {
+        string line = lines[i];
+        if (i == index) {
+            if (line.find('{') == string::npos) return false;
+            line = line.substr(line.find('{'));
+        }
+        count_braces(line, depth, in_comment);
+        text += line + "\n";
+        if (depth <= 0) {
+            text = text.substr(1, text.rfind('}') - 1);
+            if (text.find_first_of("(#\"") != string::npos) return false;
+            set<string> ids;
+            collect_identifiers(text, ids);
+            if (ids.count("new") || ids.count("delete") || ids.count("static") || ids.count("goto")) return false;
+            string head = lines[index];
+            auto open = head.find('('), close = head.find(')', open);
+            set<string> params;
+            if (open != string::npos && close != string::npos) {
+                string list = head.substr(open + 1, close - open - 1) + ",";
+                for(size_t at = 0, comma; (comma = list.find(',', at)) != string::npos; at = comma + 1) {
+                    string p = trim(list.substr(at, comma - at));
+                    p = p.substr(0, p.find('['));
+                    params.insert(read_symbol_backwards(p, p.size()));
+                }
+            }
+            return self_contained(text, params);
+        }
+    }
+    return false;
+}
+
+// #bench [param=v1,v2,...] [bytes=expr]: the next function becomes a case of the /BENCH runner,
+// called as func(param) for every value in the sweep (or func() without one)
+struct BenchCase {
+    string func, file, param, bytes;
+    vector<string> values;
+    bool isVoid;
+    int line;
+};
+static vector<BenchCase> bench_cases;
+
+struct AsyncFunction {
+    string name, ret, params;
+    vector<pair<string, string> > fields;
+    vector<string> awaits;
+    string body;
+    int depth, line;
+    bool isPrivate;
+};
+
+static string add_frame_field(AsyncFunction& af, string type, string name) {
+    string base = name.substr(0, name.find('['));
+    for(auto& f: af.fields) {
+        if (f.second.substr(0, f.second.find('[')) != base) continue;
+        if (f.first != type || f.second != name) return "'" + base + "' is declared twice with different types in async function";
+        return "";
+    }
+    af.fields.push_back(make_pair(type, name));
+    return "";
+}
+
+// locals live in the frame, so a declaration becomes a plain assignment: "i32 n = 0;" -> "n = 0;"
+static string strip_declaration(string code, string name) {
+    for(size_t at = code.find(name); at != string::npos; at = code.find(name, at + 1)) {
+        if (at && (isalnum(code[at-1]) || code[at-1] == '_')) continue;
+        size_t end = at + name.size();
+        if (end < code.size() && (isalnum(code[end]) || code[end] == '_')) continue;
+        int j = (int)at - 1;
+        while (j >= 0 && (isalnum(code[j]) || code[j] == '_' || code[j] == '*' || isspace(code[j]))) j--;
+        string type = trim(code.substr(j + 1, at - j - 1));
+        if (!type.size() || type == "return") continue;
+        return code.substr(0, j + 1) + (j >= 0 && code[j] != '(' ? " " : "") + code.substr(at);
+    }
+    return code;
+}
+
+// "await f(...);" suspends: the state number is saved, the function returns 0 and re-enters at
+// "au_resume<state>:". Labels are function scoped, so a user switch around the await can't capture them.
+static string lower_awaits(AsyncFunction& af, string code, string& err) {
+    const char* builtins[] = {"au_sleep", "au_yield", "au_readable", "au_writable", 0};
+    for(size_t at = code.find("await"); at != string::npos; at = code.find("await", at + 1)) {
+        if (at && (isalnum(code[at-1]) || code[at-1] == '_')) continue;
+        if (at + 5 >= code.size() || !isspace(code[at+5])) continue;
+        size_t call = at + 5;
+        while (call < code.size() && isspace(code[call])) call++;
+        string callee = read_symbol(code, call);
+        auto lpar = code.find('(', call);
+        if (!callee.size() || lpar != call + callee.size()) {
+            err = "await needs a call";
+            return code;
+        }
+        int depth = 0;
+        size_t rpar = lpar;
+        for(;rpar<code.size();rpar++) {
+            if (code[rpar] == '(') depth++;
+            if (code[rpar] == ')' && !--depth) break;
+        }
+        auto semi = code.find_first_not_of(" \t", rpar + 1);
+        if (rpar >= code.size() || semi == string::npos || code[semi] != ';') {
+            err = "await must end its statement";
+            return code;
+        }
+        string args = code.substr(lpar + 1, rpar - lpar - 1);
+        auto ls = code.find_last_of(";{}", at);
+        size_t from = (ls == string::npos) ? 0 : ls + 1;
+        string lhs = trim(code.substr(from, at - from));
+        if (lhs.size() && lhs[lhs.size()-1] == '=' && lhs.find_first_of("=!<>", lhs.size() - 2) == lhs.size() - 1) {
+            from = code.find_first_not_of(" \t", from);
+        } else {
+            lhs = "";
+            from = at;
+        }
+        string k = to_string(af.awaits.size() + 1);
+        bool builtin = false;
+        for(int i=0;builtins[i];i++) {
+            if (callee == builtins[i]) builtin = true;
+        }
+        string out;
+        if (builtin) {
+            if (lhs.size()) {
+                err = callee + " doesn't return a value";
+                return code;
+            }
+            af.awaits.push_back("");
+            out = "{ au_t->state = " + k + "; " + callee + "(au_t" + (trim(args).size() ? ", " + args : "") + "); return 0; au_resume" + k + ":; }";
+        } else if (async_functions.count(callee)) {
+            if (lhs.size() && async_functions[callee] == "void") {
+                err = "'" + callee + "' is async void, there is no result to await";
+                return code;
+            }
+            af.awaits.push_back(callee);
+            string child = "au_f->au_await" + k;
+            out = "{ " + child + " = " + callee + "(" + args + "); au_t->state = " + k + "; if (!au_join(au_t, &" + child + "->au_head)) return 0; au_resume" + k + ":; ";
+            if (lhs.size()) out += lhs + " " + child + "->au_result; ";
+            out += "free(" + child + "); }";
+        } else {
+            err = "await needs an async member function or au_sleep/au_yield/au_readable/au_writable, not '" + callee + "'";
+            return code;
+        }
+        code = code.substr(0, from) + out + code.substr(semi + 1);
+        at = from + out.size() - 1;
+    }
+    return code;
+}
+
+static string lower_returns(string code) {
+    for(size_t at = code.find("return"); at != string::npos; at = code.find("return", at + 1)) {
+        if (at && (isalnum(code[at-1]) || code[at-1] == '_')) continue;
+        if (at + 6 < code.size() && (isalnum(code[at+6]) || code[at+6] == '_')) continue;
+        auto semi = code.find(';', at);
+        if (semi == string::npos) break;
+        string e = trim(code.substr(at + 6, semi - at - 6));
+        string out = "{ ";
+        if (e.size()) out += "au_f->au_result = (" + e + "); ";
+        out += "au_t->state = -1; return 1; }";
+        code = code.substr(0, at) + out + code.substr(semi + 1);
+        at += out.size() - 1;
+    }
+    return code;
+}
+
+// one body line of an async function: declarations move into the frame, awaits and returns become state machine steps
+static string lower_async_line(AsyncFunction& af, string code, set<string>& declared, map<string, string>& var_type_table, string& err) {
+    string stmt = trim(code);
+    if (!stmt.size() || stmt[0] == '#') return code;
+    string space = code.substr(0, code.find(stmt));
+    auto lbr = stmt.find('[');
+    if (lbr != string::npos && stmt.size() > 2 && stmt.substr(stmt.size() - 2) == "];" && stmt.find_first_of("=(") == string::npos && valid_type_def(trim(stmt.substr(0, lbr)))) {
+        string decl = trim(stmt.substr(0, lbr));
+        string name = read_symbol_backwards(decl, decl.size());
+        err = add_frame_field(af, trim(decl.substr(0, decl.size() - name.size())), name + stmt.substr(lbr, stmt.size() - lbr - 1));
+        return "";
+    }
+    for(auto& name: declared) {
+        err = add_frame_field(af, var_type_table[name], name);
+        if (err.size()) return code;
+        stmt = strip_declaration(stmt, name);
+    }
+    stmt = lower_returns(stmt);
+    stmt = lower_awaits(af, stmt, err);
+    return space + stmt + "\n";
+}
+
+static void finish_async_function(AsyncFunction& af, string& head, string& body) {
+    string frame = af.name + "_frame";
+    string decl = "typedef struct " + frame + " {\n\tau_task au_head;\n";
+    map<string, string> renames;
+    string init;
+    string params = af.params.substr(1, af.params.size() - 2);
+    while (trim(params).size() && trim(params) != "void") {
+        auto comma = params.find(',');
+        string p = trim(params.substr(0, comma));
+        params = (comma == string::npos) ? "" : params.substr(comma + 1);
+        string name = read_symbol_backwards(p, p.size());
+        decl += "\t" + trim_type(p.substr(0, p.size() - name.size())) + " " + name + ";\n";
+        init += "\tau_f->" + name + " = " + name + ";\n";
+        renames[name] = "au_f->" + name;
+    }
+    for(auto& f: af.fields) {
+        decl += "\t" + f.first + " " + f.second + ";\n";
+        renames[f.second.substr(0, f.second.find('['))] = "au_f->" + f.second.substr(0, f.second.find('['));
+    }
+    if (af.ret != "void") decl += "\t" + af.ret + " au_result;\n";
+    for(int i=0;i<af.awaits.size();i++) {
+        if (af.awaits[i].size()) decl += "\tstruct " + af.awaits[i] + "_frame* au_await" + to_string(i + 1) + ";\n";
+    }
+    decl += "} " + frame + ";\n";
+    head += decl + frame + "* " + af.name + af.params + ";\n";
+    body += "static int " + af.name + "_resume(au_task* au_t) {\n";
+    body += "\t" + frame + "* au_f = (" + frame + "*)au_t;\n";
+    body += "\t(void)au_f;\n";
+    body += "\tswitch (au_t->state) {\n\tcase 0: break;\n";
+    for(int i=0;i<af.awaits.size();i++) body += "\tcase " + to_string(i + 1) + ": goto au_resume" + to_string(i + 1) + ";\n";
+    body += "\t}\n";
+    string line;
+    for(auto c: af.body) {
+        line += c;
+        if (c != '\n') continue;
+        body += (line[0] == '#') ? line : rename_identifiers(line, renames);
+        line = "";
+    }
+    body += "\tau_t->state = -1;\n\treturn 1;\n}\n";
+    body += frame + "* " + af.name + af.params + " {\n";
+    body += "\t" + frame + "* au_f = (" + frame + "*)calloc(1, sizeof(" + frame + "));\n";
+    body += "\tau_f->au_head.resume = " + af.name + "_resume;\n";
+    body += init + "\treturn au_f;\n}\n";
+}
+
+static bool is_data_definition(string code) {
+    code = trim(code);
+    if (!code.size() || code[0] == '#' || code[0] == '}' || code[0] == ';') return false;
+    if (code.find("//") == 0 || code.find("/*") == 0) return false;
+    const char* skip[] = {"typedef ", "struct ", "enum ", "union ", "extern ", 0};
+    for(int i=0;skip[i];i++) {
+        if (code.find(skip[i]) == 0) return false;
+    }
+    auto lpar = code.find('(');
+    auto eq = code.find('=');
+    if (lpar != string::npos && (eq == string::npos || lpar < eq)) return false;
+    return true;
+}
+
+// "T* x = new T(...);" where x is only ever dereferenced (x->f, x->m()) and is deleted at the
+// same brace depth later in the function: the object can't outlive the scope, so it gets a stack slot
+// T_method -> whether the body may store 'this' anywhere: anything but this->field (and the
+// constructor's 'return this;') counts, including calling other methods through this
+static map<string, bool> keeps_this;
+
+static void scan_this_uses(vector<string>& lines) {
+    int depth = 0;
+    bool in_comment = false;
+    for(int i=0;i<lines.size();i++) {
+        string head = code_only(lines[i], in_comment);
+        int start = depth;
+        count_braces(lines[i], depth, in_comment);
+        auto member = head.find("::");
+        if (start != 0 || member == string::npos || head.find('{') == string::npos || head.find('(') < member) continue;
+        string obj = read_symbol_backwards(head, member);
+        string func = read_symbol(head, member + 2);
+        if (!obj.size() || !func.size()) continue;
+        string body = head.substr(head.find('{'));
+        bool comment = false;
+        for(int j=i+1;depth > 0 && j<lines.size();j++) {
+            body += " " + code_only(lines[j], comment);
+            count_braces(lines[j], depth, comment);
+            i = j;
+        }
+        in_comment = comment;
+        bool keeps = false;
+        for(size_t at = body.find("this"); at != string::npos && !keeps; at = body.find("this", at + 4)) {
+            if ((at && (isalnum(body[at-1]) || body[at-1] == '_')) || isalnum(body[at+4]) || body[at+4] == '_') continue;
+            size_t n = body.find_first_not_of(" \t", at + 4);
+            if (n != string::npos && body.compare(n, 2, "->") == 0) {
+                string field = read_symbol(body, body.find_first_not_of(" \t", n + 2));
+                size_t after = body.find_first_not_of(" \t", body.find(field, n) + field.size());
+                keeps = !field.size() || (after != string::npos && body[after] == '(');
+                continue;
+            }
+            bool returned = read_symbol_backwards(body, at) == "return" && n != string::npos && body[n] == ';';
+            keeps = !(func == "new" && returned);
+        }
+        keeps_this[obj + "_" + func] = keeps;
+    }
+}
+
+static bool stores_this(string type, string method) {
+    auto it = keeps_this.find(type + "_" + method);
+    return it == keeps_this.end() || it->second;
+}
+
+static map<int, string> stack_candidates(vector<string>& lines, int index, string filename) {
+    map<int, string> out;
+    vector<int> depth_at;
+    int depth = 0, end = index;
+    bool in_comment = false;
+    for(;end<lines.size();end++) {
+        depth_at.push_back(depth);
+        count_braces(lines[end], depth, in_comment);
+        if (depth <= 0) break;
+    }
+    for(int i=index+1;i<end;i++) {
+        string l = trim(lines[i]);
+        auto star = l.find('*');
+        auto eq = l.find('=');
+        if (star == string::npos || eq == string::npos || star > eq || l.size() < 2 || l.substr(l.size() - 2) != ");") continue;
+        string type = trim(l.substr(0, star));
+        string var = trim(l.substr(star + 1, eq - star - 1));
+        string init = trim(l.substr(eq + 1));
+        if (!type.size() || read_symbol(type, 0) != type || !var.size() || read_symbol(var, 0) != var) continue;
+        if (init.find("new ") != 0 || trim(init.substr(4)).find(type + "(") != 0 || init.find(';') != init.size() - 1) continue;
+        auto info = global_structs.find(type);
+        if (info == global_structs.end() || !info->second.size || (!info->second.inHeader && info->second.source != filename)) continue;
+        // big objects stay on the heap, threads and fibers can have small stacks
+        if (info->second.size > 4096) continue;
+        // the constructor gets 'this' too
+        bool ok = !stores_this(type, "new");
+        int deleted = -1;
+        for(int j=i+1;j<end && ok;j++) {
+            string u = lines[j];
+            if (trim(u) == "delete " + var + ";") {
+                if (deleted >= 0 || depth_at[j - index] != depth_at[i - index]) ok = false;
+                deleted = j;
+                continue;
+            }
+            for(size_t at = u.find(var); at != string::npos && ok; at = u.find(var, at + 1)) {
+                if (at && (isalnum(u[at-1]) || u[at-1] == '_')) continue;
+                size_t after = at + var.size();
+                if (after < u.size() && (isalnum(u[after]) || u[after] == '_')) continue;
+                int before = (int)at - 1;
+                while (before >= 0 && isspace(u[before])) before--;
+                if (before >= 0 && (u[before] == '.' || (u[before] == '>' && before && u[before-1] == '-'))) continue;
+                while (after < u.size() && isspace(u[after])) after++;
+                bool deref = u.compare(after, 2, "->") == 0 || (after < u.size() && u[after] == '.');
+                if (!deref || deleted >= 0 || (before >= 0 && u[before] == '&')) ok = false;
+                if (!ok) continue;
+                // a method call hands over 'this'
+                size_t m = u.find_first_not_of(" \t", after + (u[after] == '.' ? 1 : 2));
+                string method = m == string::npos ? "" : read_symbol(u, m);
+                size_t call = u.find_first_not_of(" \t", m + method.size());
+                if (method.size() && call != string::npos && u[call] == '(' && stores_this(type, method)) ok = false;
+            }
+        }
+        // an early exit would skip the delete, which is harmless on the heap but not on the stack
+        bool comment = false;
+        for(int j=i+1;ok && deleted >= 0 && j<deleted;j++) {
+            set<string> ids;
+            collect_identifiers(code_only(lines[j], comment), ids);
+            if (ids.count("return") || ids.count("break") || ids.count("continue") || ids.count("goto")) ok = false;
+        }
+        if (ok && deleted >= 0) out[i] = var;
+    }
+    return out;
+}
+
+struct FunctionSpan {
+    string name;
+    size_t start, end;
+    int first_line, last_line;
+    bool isPrivate;
+    set<string> refs;
+    bool isData, isStatic;
+    string decl; // data: one declaration per line, without initializers
+};
+
+// "int *a = 0, b[4] = {1}, c;" -> "int *a\nint b[4]\nint c"
+static string split_declarators(string stmt) {
+    vector<string> parts;
+    string part;
+    int depth = 0;
+    char quote = 0;
+    bool init = false;
+    for(auto c: stmt) {
+        if (quote) {
+            if (c == quote) quote = 0;
+            continue;
+        }
+        if (c == '"' || c == '\'') quote = c;
+        if (c == '(' || c == '[' || c == '{') depth++;
+        if (c == ')' || c == ']' || c == '}') depth--;
+        if (!depth && (c == ',' || c == ';')) {
+            parts.push_back(trim(part));
+            part = "";
+            init = false;
+            if (c == ';') break;
+            continue;
+        }
+        if (!depth && c == '=') init = true;
+        if (!init) part += c;
+    }
+    if (trim(part).size()) parts.push_back(trim(part));
+    if (!parts.size()) return "";
+    string first = parts[0];
+    string name = read_symbol_backwards(first, first.find('[') == string::npos ? first.size() : first.find('['));
+    size_t at = first.rfind(name, first.find('['));
+    string base = first.substr(0, at);
+    while (base.size() && (base[base.size()-1] == '*' || isspace(base[base.size()-1]))) base = base.substr(0, base.size()-1);
+    string out = first;
+    for(int i=1;i<parts.size();i++) out += "\n" + base + " " + parts[i];
+    return out;
+}
+
+// struct qualifiers only count in front of a struct definition: elsewhere the word is an ordinary name ('soa = soa + 1;')
+static bool qualifies_struct(string rest) {
+    const char* qualifiers[] = {"const ", "custom ", "opaque ", "packed ", "wire ", "persistent ", "cacheline ", "soa ", "pooled ", "private ", "public ", "static ", 0};
+    rest = trim(rest);
+    for(int i=0;qualifiers[i];) {
+        if (rest.find(qualifiers[i]) == 0) {
+            rest = trim(rest.substr(strlen(qualifiers[i])));
+            i = 0;
+        } else if (rest.find("aligned(") == 0 && rest.find(')') != string::npos) {
+            rest = trim(rest.substr(rest.find(')') + 1));
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    return (rest.find("struct ") == 0 || rest.find("class ") == 0) && rest.find('{') != string::npos;
+}
+
+// pooled and over-aligned structs change how every file allocates them, so they're flagged before anything compiles
+static void scan_struct_qualifiers(string code, string& open_struct) {
+    const char* qualifiers[] = {"const ", "custom ", "opaque ", "packed ", "soa ", "private ", "public ", "static ", 0};
+    if (open_struct.size()) {
+        if (code.find("isolated ") == 0) global_symbol_flags[open_struct] |= 256;
+        if (code == "}" || code == "};") open_struct = "";
+        return;
+    }
+    bool pooled = false, aligned = false;
+    for(int i=0;qualifiers[i];) {
+        if (code.find("pooled ") == 0) {
+            pooled = true;
+            code = trim(code.substr(7));
+            i = 0;
+        } else if (code.find("cacheline ") == 0) {
+            aligned = true;
+            code = trim(code.substr(10));
+            i = 0;
+        } else if (code.find("aligned(") == 0 && code.find(')') != string::npos) {
+            aligned = true;
+            code = trim(code.substr(code.find(')') + 1));
+            i = 0;
+        } else if (code.find(qualifiers[i]) == 0) {
+            code = trim(code.substr(strlen(qualifiers[i])));
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    if (code.find("struct ") != 0 || code.find('{') == string::npos) return;
+    code = trim(code.substr(7));
+    string tname;
+    for(auto c: code) {
+        if (!isalnum(c) && c != '_') break;
+        tname += c;
+    }
+    if (!tname.size()) return;
+    open_struct = tname;
+    if (pooled) global_symbol_flags[tname] |= 128;
+    if (aligned) global_symbol_flags[tname] |= 256;
+}
+
+// await has to know which calls return frames before the callee's file has been compiled
+static void scan_async_function(string code) {
+    const char* qualifiers[] = {"const ", "custom ", "private ", "public ", "static ", 0};
+    for(int i=0;qualifiers[i];) {
+        if (code.find(qualifiers[i]) == 0) {
+            code = trim(code.substr(strlen(qualifiers[i])));
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    if (code.find("async ") != 0) return;
+    code = trim(code.substr(6));
+    auto member = code.find("::");
+    if (member == string::npos || code.find('(') < member) return;
+    string obj = read_symbol_backwards(code, member);
+    string func = read_symbol(code, member + 2);
+    async_functions[obj + "_" + func] = trim_type(code.substr(0, member - obj.size()));
+}
+
+// #generate name T[N] { ... }: the block is plain C (plus the prelude and the #includes/#defines above it)
+// that fills name[] on the host at build time.
+// The printed initializer is cached in build_dir/generate/ keyed by the hash of the generator source
+// and of the local headers it pulls in, so editing one of those re-runs the generator.
+static void local_includes(string code, string dir, set<string>& seen, string& out) {
+    for(size_t at = code.find("#include"); at != string::npos; at = code.find("#include", at + 8)) {
+        size_t q = code.find_first_not_of(" \t", at + 8);
+        if (q == string::npos || code[q] != '"') continue;
+        size_t e = code.find('"', q + 1);
+        if (e == string::npos) continue;
+        string fn = dir + code.substr(q + 1, e - q - 1);
+        if (seen.count(fn)) continue;
+        seen.insert(fn);
+        string text = read_file(fn);
+        out += fn + "\n" + text;
+        local_includes(text, extract_dir(fn), seen, out);
+    }
+}
+
+static bool generate_table(string name, string type, string dims, string prefix, string block, string filename, int line_no, string& out, string& err) {
+    string src((char*)austere_h, austere_h_len);
+    src += "#include <stdio.h>\n#include <math.h>\n" + prefix + type + " " + name + dims + ";\n";
+    src += "int main() {\n#line " + to_string(line_no) + " \"" + filename + "\"\n" + block + "\n";
+    src += "    " + type + "* au_p = (" + type + "*)" + name + ";\n";
+    src += "    unsigned long au_n = sizeof(" + name + ") / sizeof(" + type + ");\n";
+    src += "    for (unsigned long i = 0; i < au_n; i++) {\n";
+    src += "        if ((" + type + ")0.5) {\n";
+    src += "            double v = (double)au_p[i];\n";
+    src += "            if (v != v) printf(\"__builtin_nan(\\\"\\\")\");\n";
+    src += "            else if (isinf(v)) printf(\"%s__builtin_inf()\", v < 0 ? \"-\" : \"\");\n";
+    src += "            else printf(\"%a\", v);\n";
+    src += "        } else if (au_p[i] < 0) printf(\"%lld\", (long long)au_p[i]);\n";
+    src += "        else printf(\"%llu\", (unsigned long long)au_p[i]);\n";
+    src += "        printf(i + 1 == au_n ? \"\\n\" : i % 8 == 7 ? \",\\n\\t\" : \", \");\n";
+    src += "    }\n    return 0;\n}\n";
+    char hash[32];
+    set<string> seen;
+    string deps;
+    local_includes(prefix, extract_dir(filename), seen, deps);
+    snprintf(hash, sizeof(hash), "%016llx", wire_hash(host_compiler + "\n" + src + deps));
+    string gdir = build_dir + "generate/";
+    mkdir(build_dir.c_str(), 0777);
+    mkdir(gdir.c_str(), 0777);
+    string base = gdir + hash;
+    string table = read_file(base + ".txt");
+    if (!table.size()) {
+        if (!write_file(base + ".c", src)) {
+            err = "failed to write file " + base + ".c";
+            return false;
+        }
+        string cmd = host_compiler + " -O2 -w -o '" + base + "' '" + base + ".c' -I'" + extract_dir(filename) + "' -lm";
+        if (!quiet) printf("%s\n", cmd.c_str());
+        if (system(cmd.c_str())) {
+            err = "failed to compile #generate block for " + name;
+            return false;
+        }
+        cmd = "'" + base + "' > '" + base + ".tmp'";
+        if (!quiet) printf("%s\n", cmd.c_str());
+        if (system(cmd.c_str()) || rename((base + ".tmp").c_str(), (base + ".txt").c_str())) {
+            err = "#generate block for " + name + " failed to run";
+            return false;
+        }
+        table = read_file(base + ".txt");
+    }
+    out = "static const " + type + " " + name + dims + " = {\n\t" + table + "};\n";
+    return true;
+}
+
+struct SourceFile {
+    string filename;
+    string head, body, tail;
+    string local_head, post_head, public_post_head, local_post_head, public_head;
+    string public_cs;
+    vector<string> public_csv;
+    string template_class;
+    vector<string> template_vars;
+    vector<string> lines;
+    map<string, string> var_type_table;
+    int outputToHeader;
+    bool valid;
+    bool processed;
+    int rearrangements;
+    bool rebuild;
+    map<string,int> symbol_flags;
+    vector<FunctionSpan> functions;
+    set<string> top_refs;
+    vector<SourceFile*> exports_to, imports_from;
+    SourceFile(const char* filename_) {
+        valid = false;
+        processed = false;
+        filename = filename_;
+        rearrangements = 0;
+        rebuild = false;
+        FILE*fp = fopen(filename_, "r");
+        if (!fp) return;
+        int line_no = 0;
+        string open_struct;
+        while (!feof(fp)) {
+            string line = "";
+            while (!feof(fp)) {
+                int c = fgetc(fp);
+                if (c == EOF) break;
+                if (c == '\r') continue;
+                if (c == '\n') break;
+                line += (char)c;
+            }
+            line_no++;
+            string l = trim(line);
+            if (l.find("#copyright") == 0) {
+                string cline = trim(l.substr(10));
+                lines.push_back("// Copyright (C) "+cline+"\n");
+                auto clip = cline.find('<');
+                if (clip != string::npos) {
+                    cline = trim(cline.substr(0, clip));
+                }
+                if (copyright.size()) {
+                    copyright += ", ";
+                }
+                copyright += cline;
+                continue;
+            }
+            scan_struct_qualifiers(l, open_struct);
+            scan_async_function(l);
+            if (l.find("#template") == 0) {
+                lines.push_back("");
+                if (template_class.size()) {
                     fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " multiple #template directives in one file\n", filename.c_str(), line_no);
                     continue;
                 }
@@ -950,6 +2773,7 @@ struct SourceFile {
             lines.push_back(line);
         }
         fclose(fp);
+        scan_this_uses(lines);
         valid = true;
     }
     bool Compile(map<string, string> template_params = map<string, string>()) {
@@ -958,12 +2782,56 @@ struct SourceFile {
         int ifdef_depth = 0;
         int platform = 0;
         int build_mode = 0;
+        int brace_depth = 0;
+        bool in_comment = false;
+        int open_span = -1;
+        int open_data = -1;
+        string cur_struct;
+        int soa_struct = 0;
+        int pooled_struct = 0;
+        int wire_struct = 0;
+        int persistent_struct = 0;
+        int layout_struct = 0;
+        int struct_line = 0;
+        string layout_buf, layout_indent;
+        int inline_function = 0;
+        ParallelFor pfor;
+        bool pfor_active = false;
+        int pfor_count = 0;
+        string pfor_outlined;
+        AsyncFunction af;
+        bool async_active = false;
+        set<string> async_declared;
+        map<int, string> stack_vars;
+        string gen_name, gen_type, gen_dims, gen_block, gen_prefix;
+        BenchCase bench;
+        bool bench_pending = false;
+        int gen_depth = 0, gen_line = 0;
+        bool gen_active = false, gen_comment = false, gen_plat = true;
         for(string line: lines) {
             line_no++;
             for(auto i: template_params) {
                 line = str_replace(line, "<"+i.first+">", i.second);
                 line = str_replace(line, i.first, i.second);
             }
+            if (gen_active) {
+                count_braces(line, gen_depth, gen_comment);
+                if (gen_depth > 0) {
+                    gen_block += line + "\n";
+                    continue;
+                }
+                gen_active = false;
+                if (!gen_plat) continue;
+                gen_block += line.substr(0, line.rfind('}')) + "\n";
+                string table, err;
+                if (!generate_table(gen_name, gen_type, gen_dims, gen_prefix, gen_block, filename, gen_line, table, err)) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), gen_line, err.c_str());
+                    return false;
+                }
+                local_head += table;
+                top_refs.insert(gen_name);
+                continue;
+            }
             string space, code;
             bool trigger = false;
             for(auto c: line) {
@@ -986,11 +2854,88 @@ struct SourceFile {
                 if (plat) libs.push_back(lib);
                 continue;
             }
-            if (code.find("#vendor") == 0) {
-                string x = trim(code.substr(7));
-                if (plat) {
-                    if (vendor.size()) vendor += ", ";
-                    vendor += x;
+            if (code.find("#generate") == 0) {
+                string x = trim(code.substr(9));
+                gen_name = read_symbol(x, 0);
+                x = trim(x.substr(gen_name.size()));
+                auto brace = x.find('{');
+                auto dim = x.find('[');
+                if (!gen_name.size() || brace == string::npos || dim == string::npos || dim > brace) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " expected #generate name type[size] {\n", filename.c_str(), line_no);
+                    return false;
+                }
+                gen_type = trim(x.substr(0, dim));
+                gen_dims = trim(x.substr(dim, brace - dim));
+                gen_depth = 0;
+                gen_comment = false;
+                gen_line = line_no;
+                gen_block = x.substr(brace + 1) + "\n";
+                count_braces(x.substr(brace), gen_depth, gen_comment);
+                if (gen_depth <= 0) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " #generate block must end on its own line\n", filename.c_str(), line_no);
+                    return false;
+                }
+                gen_active = true;
+                gen_plat = plat;
+                continue;
+            }
+            if (code.find("#bench") == 0) {
+                if (bench_pending) {
+                    fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " #bench is not followed by a function, ignored\n", filename.c_str(), bench.line);
+                }
+                bench = BenchCase();
+                bench.file = filename;
+                bench.line = line_no;
+                string x = trim(code.substr(6));
+                while (x.size()) {
+                    if (x.find("bytes=") == 0) {
+                        bench.bytes = trim(x.substr(6));
+                        break;
+                    }
+                    auto sp = x.find_first_of(" \t");
+                    string tok = x.substr(0, sp);
+                    x = sp == string::npos ? "" : trim(x.substr(sp));
+                    auto eq = tok.find('=');
+                    if (eq == string::npos || bench.param.size()) {
+                        fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " expected #bench [param=v1,v2,...] [bytes=expr]\n", filename.c_str(), line_no);
+                        return false;
+                    }
+                    bench.param = tok.substr(0, eq);
+                    string v = tok.substr(eq + 1) + ",";
+                    for(size_t at = 0, comma; (comma = v.find(',', at)) != string::npos; at = comma + 1) {
+                        if (comma > at) bench.values.push_back(v.substr(at, comma - at));
+                    }
+                }
+                bench_pending = plat;
+                continue;
+            }
+            if (code.find("#embed") == 0) {
+                // #embed name "file": the assembler pulls the file in with .incbin, C sees name[] and name_len
+                string x = trim(code.substr(6));
+                string name = read_symbol(x, 0);
+                string fn = trim2(trim(x.substr(name.size())), '"');
+                if (!name.size() || !fn.size()) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " expected #embed name \"file\"\n", filename.c_str(), line_no);
+                    return false;
+                }
+                if (fn[0] != '/') fn = extract_dir(filename) + fn;
+                char* abs = realpath(fn.c_str(), 0);
+                if (!abs) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " cannot find embedded file %s\n", filename.c_str(), line_no, fn.c_str());
+                    return false;
+                }
+                if (plat) {
+                    embeds.push_back(make_pair(name, string(abs)));
+                    head += "extern const u8 "+name+"[];\nextern const u64 "+name+"_len;\n";
+                }
+                free(abs);
+                continue;
+            }
+            if (code.find("#vendor") == 0) {
+                string x = trim(code.substr(7));
+                if (plat) {
+                    if (vendor.size()) vendor += ", ";
+                    vendor += x;
                 }
                 continue;
             }
@@ -1022,6 +2967,7 @@ struct SourceFile {
             if (code.find("#public_") == 0) {
                 if (plat) {
                     string z = space + "#" + line.substr(line.find("#public_") + 8);
+                    collect_identifiers(z, top_refs);
                     public_head += z + "\n";
                     //local_head += z + "\n";
                     head += z + "\n";
@@ -1033,6 +2979,7 @@ struct SourceFile {
             if (code.find("#global_") == 0) {
                 if (plat) {
                     string z = space + "#" + line.substr(line.find("#global_") + 8);
+                    collect_identifiers(z, top_refs);
                     //local_head += z + "\n";
                     head += z + "\n";
                     body += line_directive(z+"\n", human, line_no, filename);
@@ -1041,6 +2988,8 @@ struct SourceFile {
             }
             if (code.find("#define") == 0 || code.find("#include") == 0) {
                 if (plat) {
+                    gen_prefix += code + "\n";
+                    collect_identifiers(code, top_refs);
                     local_head += line + "\n";
                     //body += line_directive(line+"\n", human, line_no, filename);
                 }
@@ -1106,6 +3055,64 @@ struct SourceFile {
             if (platform == -PLAT_WINDOWS && os == "windows") continue;
             if (platform == -PLAT_LINUX && os == "linux") continue;
             if (platform == -PLAT_APPLE && os == "apple") continue;
+            if (code.find("parallel ") == 0 && trim(code.substr(8)).find("for") == 0) {
+                ParallelFor pf;
+                string err = parse_parallel_for(code, pf, var_type_table);
+                if (!err.size() && pfor_active) err = "nested parallel for";
+                if (err.size()) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
+                    return false;
+                }
+                if (openmp_mode) {
+                    body += line_directive(space + parallel_for_pragma(pf) + "\n", human, line_no, filename);
+                    code = "for (" + pf.header + ") {";
+                } else {
+                    pfor = pf;
+                    pfor.scope = var_type_table;
+                    pfor.depth = brace_depth;
+                    pfor.line = line_no;
+                    var_type_table[pf.var] = pf.type;
+                    pfor_active = true;
+                    uses_runtime = true;
+                    brace_depth++;
+                    continue;
+                }
+            }
+            if (pfor_active && brace_depth == pfor.depth + 1 && code == "}") {
+                string call;
+                string err = outline_parallel_for(pfor, "au_pfor" + to_string(pfor_count++), space, local_head, pfor_outlined, call);
+                if (err.size()) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), pfor.line, err.c_str());
+                    return false;
+                }
+                if (async_active) af.body += line_directive(call, human, pfor.line, filename);
+                else body += line_directive(call, human, pfor.line, filename);
+                if (open_span >= 0) collect_identifiers(call, functions[open_span].refs);
+                brace_depth--;
+                pfor_active = false;
+                continue;
+            }
+            if (async_active && !pfor_active && brace_depth == af.depth + 1 && code == "}") {
+                FunctionSpan fs;
+                fs.name = af.name;
+                fs.start = body.size();
+                fs.first_line = af.line;
+                fs.last_line = line_no;
+                fs.isPrivate = af.isPrivate;
+                fs.isData = false;
+                fs.isStatic = false;
+                finish_async_function(af, af.isPrivate ? local_head : head, body);
+                body += pfor_outlined;
+                pfor_outlined = "";
+                collect_identifiers(body.substr(fs.start), fs.refs);
+                fs.end = body.size();
+                functions.push_back(fs);
+                brace_depth--;
+                async_active = false;
+                uses_runtime = true;
+                continue;
+            }
+            string member = code;
             int isConst = 0;
             if (code.find("const ") == 0) {
                 isConst = 1;
@@ -1138,6 +3145,58 @@ struct SourceFile {
                     code = code.substr(1);
                 }
             }
+            int isWire = 0;
+            if (code.find("wire ") == 0 && qualifies_struct(code.substr(4))) {
+                isWire = 1;
+                isPacked = 1;
+                code = code.substr(4);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            int isPersistent = 0;
+            if (code.find("persistent ") == 0 && qualifies_struct(code.substr(10))) {
+                isPersistent = 1;
+                code = code.substr(10);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            int alignment = 0;
+            if (code.find("cacheline ") == 0 && qualifies_struct(code.substr(9))) {
+                alignment = 64;
+                code = code.substr(9);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            } else if (code.find("aligned(") == 0 && code.find(')') != string::npos && qualifies_struct(code.substr(code.find(')') + 1))) {
+                string n = trim(code.substr(8, code.find(')') - 8));
+                alignment = atoi(n.c_str());
+                if (alignment <= 0 || (alignment & (alignment - 1)) || n.find_first_not_of("0123456789") != string::npos) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " aligned(%s) needs a power of two\n", filename.c_str(), line_no, n.c_str());
+                    return false;
+                }
+                code = code.substr(code.find(')') + 1);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            int isSoa = 0;
+            if (code.find("soa ") == 0 && qualifies_struct(code.substr(3))) {
+                isSoa = 1;
+                code = code.substr(3);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            int isPooled = 0;
+            if (code.find("pooled ") == 0 && qualifies_struct(code.substr(6))) {
+                isPooled = 1;
+                code = code.substr(6);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
             int isPrivate = 0;
             if (code.find("private ") == 0) {
                 isPrivate = 1;
@@ -1146,97 +3205,1026 @@ struct SourceFile {
                     code = code.substr(1);
                 }
             }
-            int isPublic = 0;
-            if (code.find("public ") == 0) {
-                isPublic = 1;
-                code = code.substr(6);
-                while (code.size() && isspace(code[0])) {
-                    code = code.substr(1);
+            int isPublic = 0;
+            if (code.find("public ") == 0) {
+                isPublic = 1;
+                code = code.substr(6);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            int isStatic = 0;
+            if (code.find("static ") == 0) {
+                isStatic = 1;
+                code = code.substr(6);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            int hotness = 0;
+            if (code.find("hot ") == 0 || (code.find("cold ") == 0 && !(cur_struct.size() && tail.size()))) {
+                // inside a struct 'hot' marks a field for /LAYOUT, elsewhere it's a function qualifier;
+                // on any other line it's an ordinary name ('hot = hot + 1;') and the line is left alone
+                string rest = code.substr(code[0] == 'h' ? 3 : 4);
+                while (rest.size() && isspace(rest[0])) {
+                    rest = rest.substr(1);
+                }
+                if (cur_struct.size() && tail.size()) {
+                    code = rest;
+                } else if (brace_depth == 0 && is_function_head(rest)) {
+                    hotness = (code[0] == 'h') ? 1 : 2;
+                    code = rest;
+                } else if (rest.size() && (isalpha(rest[0]) || rest[0] == '_')) {
+                    fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " '%s' only applies to function definitions\n", filename.c_str(), line_no, code[0] == 'h' ? "hot" : "cold");
+                }
+            }
+            int isIsolated = 0;
+            if (cur_struct.size() && tail.size() && code.find("isolated ") == 0) {
+                isIsolated = 1;
+                code = code.substr(8);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            int isFast = 0;
+            string fast_rest = code.find("fast ") == 0 ? trim(code.substr(4)) : "";
+            // like hot/cold, only a qualifier in front of a function definition ('fast = fast + 1;' is left alone)
+            if (fast_rest.size() && brace_depth == 0 && !(cur_struct.size() && tail.size()) && is_function_head(fast_rest)) {
+                isFast = 1;
+                code = fast_rest;
+                if (!isPublic && !isOpaque) {
+                    fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " 'fast' only affects public/opaque functions called from C#, ignored\n", filename.c_str(), line_no);
+                }
+            }
+            int isInline = 0;
+            if (code.find("inline ") == 0) {
+                isInline = 1;
+                code = code.substr(6);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            int isAsync = 0;
+            string async_rest = code.find("async ") == 0 ? trim(code.substr(5)) : "";
+            // 'async = async + 1;' is a variable, the qualifier is always followed by the return type
+            if (async_rest.size() && (isalpha(async_rest[0]) || async_rest[0] == '_')) {
+                isAsync = 1;
+                code = code.substr(5);
+                while (code.size() && isspace(code[0])) {
+                    code = code.substr(1);
+                }
+            }
+            auto memberHint = code.find("::");
+            int isMember = (memberHint != string::npos);
+            if (isInline && !isMember) {
+                code = "inline " + code;
+                isInline = 0;
+            }
+            if (isMember) {
+                string obj = read_symbol_backwards(code, memberHint);
+                if (obj.size()) {
+                    var_type_table["this"] = obj+"*";
+                    symbol_flags[obj] |= 4 + 8;
+                } else {
+                    fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " failed to deduce type for 'this'\n", filename.c_str(), line_no);
+                }
+            }
+            string plain = code;
+            if (brace_depth == 0 && is_function_head(code)) {
+                // async locals live in the frame, not on the stack
+                if (isAsync) stack_vars.clear();
+                else stack_vars = stack_candidates(lines, line_no - 1, filename);
+                string err = rewrite_noalias(code, plain);
+                if (err.size()) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
+                    return false;
+                }
+            }
+            if (isAsync) {
+                if (!isMember || brace_depth != 0 || open_span >= 0 || !is_function_head(code)) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " async needs a member function definition with '{' on its first line\n", filename.c_str(), line_no);
+                    return false;
+                }
+                if (isPublic || isOpaque || isInline) {
+                    fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " async functions can't be public, opaque or inline\n", filename.c_str(), line_no);
+                    return false;
+                }
+                // the body is collected and lowered to a frame struct, a resume function and a creator when it closes
+                string hcode = resolve_member_functions(plain, 1, isStatic, isConst, isCustom, var_type_table);
+                auto lpar = hcode.find('(');
+                af = AsyncFunction();
+                af.name = read_symbol_backwards(hcode, lpar);
+                af.ret = trim_type(hcode.substr(0, hcode.rfind(af.name, lpar)));
+                af.params = hcode.substr(lpar, hcode.find(')', lpar) - lpar + 1);
+                af.depth = brace_depth;
+                af.line = line_no;
+                af.isPrivate = isPrivate || (symbol_flags[read_symbol_backwards(code, memberHint)] & 16);
+                string params = code;
+                extract_variable_types(params, var_type_table, symbol_flags, false);
+                count_braces(code, brace_depth, in_comment);
+                async_active = true;
+                continue;
+            }
+            int inlineHere = 0;
+            if (isMember && brace_depth == 0 && open_span < 0 && is_function_head(code)) {
+                string obj = read_symbol_backwards(code, memberHint);
+                string func = read_symbol(code, memberHint + 2);
+                auto info = global_structs.find(obj);
+                bool inlinable = info != global_structs.end() && info->second.inHeader && info->second.source == filename && !isPublic && !isOpaque && func != "new" && func != "delete";
+                if (isInline && !inlinable) {
+                    fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " '%s::%s' can't be inline (public, opaque, constructor/destructor or type not defined in this file), emitted out of line\n", filename.c_str(), line_no, obj.c_str(), func.c_str());
+                }
+                if (inlinable && (isInline || small_function(lines, line_no - 1))) {
+                    inlineHere = isPrivate ? 3 : 2;
+                }
+            }
+            string hcode = resolve_member_functions(plain, 1, isStatic, isConst, isCustom, var_type_table);
+            if (isPublic && (dll_mode || cs_files.size()) && brace_depth == 0 && open_span < 0 && is_function_head(hcode) && f16_by_value(hcode)) {
+                // emitted as its own span ahead of the function, so /SHARD defines it once
+                string shim_sig;
+                FunctionSpan fs;
+                fs.start = body.size();
+                body += f16_shim(hcode, shim_sig);
+                fs.end = body.size();
+                fs.name = extract_entry_point(shim_sig);
+                fs.first_line = fs.last_line = line_no;
+                fs.isPrivate = false;
+                fs.isData = false;
+                fs.isStatic = false;
+                collect_identifiers(body.substr(fs.start), fs.refs);
+                functions.push_back(fs);
+                if (plat) export_symbols.insert(fs.name);
+            }
+            if (!inlineHere) extract_public_signatures(head, post_head, public_post_head, public_csv, local_post_head, local_head, hcode, isPacked, isPublic, isPrivate, isOpaque, isFast);
+            if (plat && hcode.find("DLLEXPORT ") != string::npos) {
+                export_symbols.insert(extract_entry_point(hcode));
+            }
+            async_declared.clear();
+            string err = extract_variable_types(code, var_type_table, symbol_flags, tail.size(), pfor_active ? &pfor.declared : async_active ? &async_declared : 0);
+            if (!err.size()) err = rewrite_placement_new(code, var_type_table, in_comment);
+            auto promote = stack_vars.find(line_no - 1);
+            if (!err.size() && promote != stack_vars.end() && brace_depth > 0) {
+                string type = var_type_table[promote->second];
+                type = type.substr(0, type.size() - 1);
+                string slot = "au_stack_" + promote->second;
+                if (code.find(type + "_new(0") != string::npos && var_type_table[type + "_new"] != "custom" && var_type_table[type + "_delete"] != "custom") {
+                    auto at = code.find(type + "_new(0");
+                    code = type + " " + slot + "; " + code.substr(0, at) + type + "_new(&" + slot + code.substr(at + type.size() + 6);
+                    var_type_table[promote->second + "@stack"] = "1";
+                }
+            }
+            if (err.size()) {
+                fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
+                return false;
+            }
+            bool inStruct = cur_struct.size() && tail.size();
+            if (!inStruct) {
+                rewrite_structs(code, head, public_head, public_csv, local_head, tail, space, &outputToHeader, isPacked, alignment, isPublic, isOpaque, isPrivate, symbol_flags, cur_struct);
+                if (cur_struct.size()) {
+                    soa_struct = isSoa;
+                    wire_struct = isWire;
+                    persistent_struct = isPersistent;
+                    global_structs[cur_struct].isPersistent = isPersistent;
+                    global_structs[cur_struct].isWire = isWire;
+                    if (isWire && alignment) {
+                        fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " wire struct '%s' is packed, it can't be aligned\n", filename.c_str(), line_no, cur_struct.c_str());
+                        return false;
+                    }
+                    pooled_struct = isPooled;
+                    if (isSoa) symbol_flags[cur_struct+"SoA"] |= 2;
+                    layout_struct = layout_mode && !isPacked && (!isPublic || isOpaque) && !isPersistent;
+                    layout_indent = "";
+                    struct_line = line_no;
+                }
+            } else if (member != "}" && member != "};") {
+                StructInfo& info = global_structs[cur_struct];
+                size_t first = info.fields.size();
+                parse_struct_fields(member, info);
+                if (!layout_indent.size()) layout_indent = space;
+                bool pointers = false;
+                for(size_t i=first;i<info.fields.size();i++) {
+                    string& t = info.fields[i].type;
+                    if (t.size() && t[t.size()-1] == '*') pointers = true;
+                }
+                if (persistent_struct && pointers && info.simple) {
+                    code = "";
+                    for(size_t i=first;i<info.fields.size();i++) {
+                        StructField& f = info.fields[i];
+                        bool ptr = f.type[f.type.size()-1] == '*';
+                        if (i > first) code += " ";
+                        code += (ptr ? string("au_rel") : f.type) + " " + f.name + (f.count > 1 ? "[" + to_string(f.count) + "]" : "") + ";";
+                    }
+                }
+            }
+            rewrite_enums(code, head, public_head, public_csv, local_head, tail, space, &outputToHeader, isPublic, isOpaque, isPrivate);
+            err = rewrite_member_calls(code, var_type_table);
+            if (err.size()) {
+                fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
+                return false;
+            }
+            if (isMember) {
+                code = resolve_member_functions(code, 0, isStatic, isConst, isCustom, var_type_table);
+            }
+            if (isIsolated) code = "struct AU_ALIGNED(AU_CACHELINE) { " + code + " };";
+            if (inlineHere == 3) {
+                // small member functions live in the header as inline, so callers in other files inline them without LTO
+                code = "static inline " + code;
+                inline_function = inlineHere;
+            } else if (inlineHere) {
+                // C99 inline: the extern declaration makes this file's copy the one external definition,
+                // which C callers and -O0 builds link against. It's a span so /SHARD emits it once.
+                FunctionSpan fs;
+                fs.name = extract_entry_point(code);
+                fs.start = body.size();
+                body += "extern " + trim(code.substr(0, code.find('{'))) + ";\n";
+                fs.end = body.size();
+                fs.first_line = fs.last_line = line_no;
+                fs.isPrivate = false;
+                fs.isData = false;
+                fs.isStatic = false;
+                functions.push_back(fs);
+                code = "inline " + code;
+                inline_function = inlineHere;
+            }
+            if (isStatic && !isMember) code = "static " + code;
+            if (isConst && !isMember) code = "const " + code;
+            if (hotness == 1) code = "AU_HOT " + code;
+            if (hotness == 2) code = "AU_COLD " + code;
+            int oth = outputToHeader;
+            if (inline_function) oth = inline_function;
+            string extra, pool, public_extra;
+            if (tail.size() && (code == "}" || code == "};")) {
+                code = tail;
+                tail = "";
+                outputToHeader = 0;
+                if (cur_struct.size()) {
+                    StructInfo& info = global_structs[cur_struct];
+                    struct_layout(info, info.align);
+                    info.original_size = info.size;
+                    info.source = filename;
+                    info.line = struct_line;
+                    if (layout_struct && info.size && reorder_fields(info)) {
+                        struct_layout(info, info.align);
+                        info.reordered = true;
+                        layout_buf = field_declarations(info, layout_indent);
+                        if (!oth) layout_buf = line_directive(layout_buf, human, struct_line + 1, filename);
+                    }
+                }
+                if (cur_struct.size() && soa_struct) {
+                    if (global_structs[cur_struct].simple) {
+                        extra = soa_container(cur_struct, global_structs[cur_struct]);
+                        // inline helpers over the public fields, so users of the exported header get them too
+                        public_extra = extra;
+                    } else {
+                        fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " soa struct '%s' has members other than plain fields, no %sSoA generated\n", filename.c_str(), line_no, cur_struct.c_str(), cur_struct.c_str());
+                    }
+                }
+                if (cur_struct.size() && wire_struct) {
+                    string err;
+                    extra += wire_accessors(cur_struct, global_structs[cur_struct], err);
+                    if (err.size()) {
+                        fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
+                        return false;
+                    }
+                }
+                if (cur_struct.size() && persistent_struct) {
+                    string err;
+                    extra += persistent_accessors(cur_struct, global_structs[cur_struct], err);
+                    if (err.size()) {
+                        fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
+                        return false;
+                    }
+                    uses_runtime = true;
+                }
+                if (cur_struct.size() && pooled_struct) pool = cur_struct;
+                cur_struct = "";
+            }
+            code = space + code + "\n";
+            bool starts_function = !oth && open_span < 0 && brace_depth == 0 && !in_comment && is_function_head(code);
+            bool starts_data = !oth && !starts_function && open_span < 0 && open_data < 0 && brace_depth == 0 && !in_comment && is_data_definition(code);
+            count_braces(code, brace_depth, in_comment);
+            if (inline_function && brace_depth <= 0) inline_function = 0;
+            if (oth || (open_span < 0 && !starts_function)) {
+                collect_identifiers(code, top_refs);
+            }
+            if (layout_struct && inStruct && member != "}" && member != "};") {
+                // held back until the struct closes, /LAYOUT may replace them with a reordered list
+                layout_buf += oth ? code : line_directive(code, human, line_no, filename);
+                continue;
+            }
+            if (layout_buf.size()) {
+                if (oth) code = layout_buf + code;
+                else body += layout_buf;
+                layout_buf = "";
+            }
+            if (oth == 1) {
+                head += code;
+                public_head += code;
+                public_csv.push_back("\x01" + code);
+                //local_head += code;
+            } else if (oth == 2) {
+                head += code;
+                //local_head += code;
+            } else if (oth == 3) {
+                local_head += code;
+            } else {
+                if (starts_function) {
+                    FunctionSpan fs;
+                    fs.name = extract_entry_point(code);
+                    fs.start = body.size();
+                    fs.first_line = line_no;
+                    fs.isPrivate = isPrivate;
+                    fs.isData = false;
+                    fs.isStatic = false;
+                    functions.push_back(fs);
+                    open_span = functions.size() - 1;
+                    if (bench_pending) {
+                        bench_pending = false;
+                        if (isPrivate || (isStatic && !isMember)) {
+                            fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " #bench function %s must not be private\n", filename.c_str(), line_no, fs.name.c_str());
+                            return false;
+                        }
+                        string ret = trim(code.substr(0, code.find(fs.name + "(")));
+                        bench.func = fs.name;
+                        bench.isVoid = ret == "void" || (ret.size() > 5 && ret.substr(ret.size() - 5) == " void");
+                        bench_cases.push_back(bench);
+                    }
+                } else if (starts_data) {
+                    FunctionSpan fs;
+                    fs.decl = split_declarators(trim(str_replace(trim(code) + " ", "static ", "")));
+                    string decl = fs.decl.substr(0, fs.decl.find('\n'));
+                    decl = decl.substr(0, decl.find('['));
+                    fs.name = read_symbol_backwards(decl, decl.size());
+                    fs.start = body.size();
+                    fs.first_line = line_no;
+                    fs.isPrivate = isPrivate;
+                    fs.isData = true;
+                    fs.isStatic = isStatic && !isMember;
+                    functions.push_back(fs);
+                    open_data = functions.size() - 1;
+                }
+                if (pfor_active) {
+                    pfor.body += line_directive(code, human, line_no, filename);
+                } else if (async_active) {
+                    code = lower_async_line(af, code, async_declared, var_type_table, err);
+                    if (err.size()) {
+                        fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
+                        return false;
+                    }
+                    af.body += line_directive(code, human, line_no, filename);
+                } else {
+                    body += line_directive(code, human, line_no, filename);
+                }
+                //body += code;
+                if (open_span >= 0) {
+                    collect_identifiers(code, functions[open_span].refs);
+                    if (brace_depth <= 0) {
+                        body += pfor_outlined;
+                        pfor_outlined = "";
+                        functions[open_span].end = body.size();
+                        functions[open_span].last_line = line_no;
+                        open_span = -1;
+                    }
+                }
+                if (open_data >= 0 && brace_depth <= 0 && code.find(';') != string::npos) {
+                    functions[open_data].end = body.size();
+                    functions[open_data].last_line = line_no;
+                    open_data = -1;
+                }
+                code = "";
+            }
+            if (extra.size()) {
+                if (oth == 1) public_head += public_extra;
+                if (oth == 1 || oth == 2) head += extra;
+                else if (oth == 3) local_head += extra;
+                else body += line_directive(extra, human, line_no, filename);
+            }
+            if (pool.size()) {
+                // the free list is a data span, so /SHARD defines it in one unit only
+                string decl = "AU_THREAD_LOCAL au_pool " + pool + "_pool";
+                if (symbol_flags[pool] & 16) local_head += "extern " + decl + ";\n";
+                else head += "extern " + decl + ";\n";
+                FunctionSpan fs;
+                fs.name = pool + "_pool";
+                fs.decl = decl;
+                fs.start = body.size();
+                fs.first_line = fs.last_line = line_no;
+                fs.isPrivate = isPrivate;
+                fs.isData = true;
+                fs.isStatic = false;
+                body += line_directive(decl + " = AU_POOL_INIT(" + pool + ");\n", human, line_no, filename);
+                fs.end = body.size();
+                functions.push_back(fs);
+            }
+        }
+        if (open_span >= 0) functions[open_span].end = body.size();
+        if (open_data >= 0) functions[open_data].end = body.size();
+        if (bench_pending) {
+            fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " #bench is not followed by a function, ignored\n", filename.c_str(), bench.line);
+        }
+        return true;
+    }
+};
+
+void set_rebuild_recursive(SourceFile* f) {
+    if (f->rebuild) return;
+    f->rebuild = true;
+    for(auto d: f->exports_to) {
+        set_rebuild_recursive(d);
+    }
+}
+
+static void prune_unreachable() {
+    set<string> live, defined;
+    vector<string> work;
+    work.push_back("main");
+    if (dll_mode || cs_files.size()) {
+        for(auto sym: export_symbols) work.push_back(sym);
+    }
+    if (bench_mode) {
+        for(auto& b: bench_cases) work.push_back(b.func);
+    }
+    bool foreign = c_files.size() || cpp_files.size() || asm_files.size() || rs_files.size();
+    for(auto f: files) {
+        if (f->template_class.size()) continue;
+        for(auto sym: f->top_refs) work.push_back(sym);
+        for(auto& fs: f->functions) {
+            if (fs.isData) continue;
+            defined.insert(fs.name);
+            // non-Austere sources may call anything that isn't private, and we can't see their call sites
+            if (foreign && !fs.isPrivate) work.push_back(fs.name);
+        }
+    }
+    while (work.size()) {
+        string sym = work.back();
+        work.pop_back();
+        if (live.count(sym) || !defined.count(sym)) continue;
+        live.insert(sym);
+        for(auto f: files) {
+            for(auto& fs: f->functions) {
+                if (fs.isData || fs.name != sym) continue;
+                for(auto r: fs.refs) {
+                    if (!live.count(r)) work.push_back(r);
+                }
+            }
+        }
+    }
+    int removed = 0;
+    size_t bytes = 0;
+    for(auto f: files) {
+        if (f->template_class.size()) continue;
+        for(int i=f->functions.size()-1;i>=0;i--) {
+            auto& fs = f->functions[i];
+            if (fs.isData || live.count(fs.name)) continue;
+            size_t len = fs.end - fs.start;
+            f->body = f->body.substr(0, fs.start) + f->body.substr(fs.end);
+            for(auto& later: f->functions) {
+                if (later.start < fs.end) continue;
+                later.start -= len;
+                later.end -= len;
+            }
+            if (!quiet) printf(" * %s:%d: removed %s (%d bytes)\n", f->filename.c_str(), fs.first_line, fs.name.c_str(), (int)len);
+            removed++;
+            bytes += len;
+            f->functions.erase(f->functions.begin() + i);
+        }
+    }
+    printf("/PRUNE: removed %d unreachable function%s (%lu bytes of generated C)\n", removed, removed == 1 ? "" : "s", (unsigned long)bytes);
+}
+
+static int run_jobs(vector<string>& jobs) {
+#ifdef _WIN32
+    for(auto cmd: jobs) {
+        if (!quiet) printf("%s\n", cmd.c_str());
+        int r = system(cmd.c_str());
+        if (r) return r;
+    }
+    return 0;
+#else
+    int slots = max_jobs;
+    if (slots <= 0) slots = sysconf(_SC_NPROCESSORS_ONLN);
+    if (slots <= 0) slots = 1;
+    int running = 0, result = 0;
+    size_t next = 0;
+    for(;;) {
+        while (!result && running < slots && next < jobs.size()) {
+            string cmd = jobs[next++];
+            if (!quiet) printf("%s\n", cmd.c_str());
+            fflush(stdout);
+            pid_t pid = fork();
+            if (!pid) {
+                execl("/bin/sh", "sh", "-c", cmd.c_str(), (char*)0);
+                _exit(127);
+            }
+            if (pid < 0) {
+                result = 1;
+                break;
+            }
+            running++;
+        }
+        if (!running) break;
+        int status = 0;
+        if (wait(&status) < 0) break;
+        running--;
+        if (!result && (!WIFEXITED(status) || WEXITSTATUS(status))) {
+            result = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+        }
+    }
+    return result;
+#endif
+}
+
+static string unit_name(SourceFile* f, int unit, int units) {
+    string name = flatten_filename(f->filename) + ".au";
+    if (units > 1) name += "." + to_string(unit);
+    return name;
+}
+
+static vector<string> shard_units(SourceFile* f, string include_list) {
+    vector<string> units;
+    bool big = (shard_lines && f->lines.size() > shard_lines) || (shard_bytes && f->body.size() > shard_bytes);
+    long limit = shard_lines ? shard_lines : shard_bytes;
+    vector<int> shard_of(f->functions.size(), 0);
+    int shards = 0;
+    long fill = 0;
+    for(int i=0;big && i<f->functions.size();i++) {
+        auto& fs = f->functions[i];
+        if (fs.isData) continue;
+        long size = shard_lines ? (fs.last_line - fs.first_line + 1) : (long)(fs.end - fs.start);
+        if (fill && fill + size > limit) {
+            shards++;
+            fill = 0;
+        }
+        shard_of[i] = shards;
+        fill += size;
+    }
+    if (!shards) {
+        units.push_back(include_list + f->local_head + f->local_post_head + f->body);
+        return units;
+    }
+    // private functions and static data are shared between shards, so they get external (but hidden) linkage under file-unique names
+    map<string, string> renames;
+    string mangle = "au_" + flatten_filename(f->filename) + "__";
+    for(auto& fs: f->functions) {
+        if (fs.name.size() && fs.isData && fs.isStatic) {
+            string decls = fs.decl + "\n", decl;
+            for(size_t at = 0, nl; (nl = decls.find('\n', at)) != string::npos; at = nl + 1) {
+                decl = decls.substr(at, nl - at);
+                decl = decl.substr(0, decl.find('['));
+                string name = read_symbol_backwards(decl, decl.size());
+                if (name.size()) renames[name] = mangle + name;
+            }
+        } else if (fs.name.size() && !fs.isData && fs.isPrivate) {
+            renames[fs.name] = mangle + fs.name;
+        }
+    }
+    string head, line;
+    for(auto c: f->local_head) {
+        line += c;
+        if (c != '\n') continue;
+        if (line.find("static ") == 0 && renames.count(extract_entry_point(line))) {
+            line = line.substr(7);
+        }
+        head += line;
+        line = "";
+    }
+    head += line + f->local_post_head;
+    for(int k=0;k<=shards;k++) {
+        string unit;
+        size_t pos = 0;
+        for(int i=0;i<f->functions.size();i++) {
+            auto& fs = f->functions[i];
+            unit += f->body.substr(pos, fs.start - pos);
+            string text = f->body.substr(fs.start, fs.end - fs.start);
+            if (fs.isData && k) {
+                text = "extern " + str_replace(fs.decl, "\n", ";\nextern ") + ";\n";
+            } else if (fs.isData && fs.isStatic) {
+                size_t at = 0;
+                while (text.find("#line", at) == at && text.find('\n', at) != string::npos) {
+                    at = text.find('\n', at) + 1;
+                }
+                auto st = text.find("static ", at);
+                if (st != string::npos) text = text.substr(0, st) + text.substr(st + 7);
+            } else if (!fs.isData && shard_of[i] != k) {
+                text = "";
+            }
+            unit += text;
+            pos = fs.end;
+        }
+        unit += f->body.substr(pos);
+        units.push_back(include_list + rename_identifiers(head + unit, renames, true));
+    }
+    return units;
+}
+
+static int build_objects(string bdir, string cflags, string include_list, bool force, string& obj_list, bool& relink) {
+    vector<string> jobs;
+    opt_reports.clear();
+    map<SourceFile*, vector<string> > units;
+    for(auto f: files) {
+        f->rebuild = false;
+        if (!f->template_class.size()) units[f] = shard_units(f, include_list);
+    }
+    for(auto f: files) {
+        for(int i=0;i<units[f].size();i++) {
+            string out_ob = bdir + unit_name(f, i, units[f].size()) + ".o";
+            if (force || should_rebuild(out_ob, file_mtime(f->filename))) {
+                set_rebuild_recursive(f);
+            }
+        }
+    }
+    for(auto f: files) {
+        if (f->template_class.size()) continue;
+        string srcdir = extract_dir(f->filename);
+        for(int i=0;i<units[f].size();i++) {
+            string out_base = bdir + unit_name(f, i, units[f].size());
+            string out_fn = out_base + ".c";
+            bool changed = false;
+            if (read_file(out_fn) != units[f][i]) {
+                // the generated C can change without the .au source changing (eg. /PRUNE results depend on other files)
+                if (!write_file(out_fn, units[f][i])) {
+                    fprintf(stderr, HILITE "%s: " ERROR_STYLE "error:" REGGS " failed to write file %s\n", f->filename.c_str(), out_fn.c_str());
+                    return 1;
+                }
+                changed = true;
+            }
+            string out_ob = out_base + ".o";
+            string cmd = compiler + " -c -o '"+out_ob+"' '"+out_fn+"' -I'" + srcdir + "' " + cflags + " " + user_auflags;
+            obj_list += " '"+out_ob+"'";
+            if (optreport_mode) {
+                // clang only prints remarks, so they are split from its diagnostics by the remark tag when reading them back
+                string rep = out_base + ".opt.txt";
+                if (compiler.find("clang") != string::npos) {
+                    cmd += " -Rpass='loop-vectorize|inline' -Rpass-missed=loop-vectorize -Rpass-analysis=loop-vectorize 2>'"+rep+"' || { cat '"+rep+"' >&2; exit 1; }";
+                } else {
+                    cmd += " -fopt-info-vec-inline-optimized-missed='"+rep+"'";
+                }
+                opt_reports.push_back(make_pair(f, rep));
+                if (file_mtime(rep) < 0) changed = true;
+            }
+            if (f->rebuild || changed) jobs.push_back(cmd);
+        }
+    }
+    for(auto f: c_files) {
+        string out_ob = bdir + flatten_filename(f) + ".c.o";
+        string cmd = compiler + " -c -o '"+out_ob+"' '"+f+"' " + cflags + " " + user_cflags;
+        obj_list += " '"+out_ob+"'";
+        if (force || should_rebuild(out_ob, file_mtime(f))) jobs.push_back(cmd);
+    }
+    for(auto f: cpp_files) {
+        string out_ob = bdir + flatten_filename(f) + ".cpp.o";
+        string cmd = cpp_compiler + " -c -o '"+out_ob+"' '"+f+"' " + cflags + " " + user_cppflags;
+        obj_list += " '"+out_ob+"'";
+        if (force || should_rebuild(out_ob, file_mtime(f))) jobs.push_back(cmd);
+    }
+    for(auto f: embed_files) {
+        string out_ob = bdir + flatten_filename(extract_filename(f)) + ".s.o";
+        string cmd = compiler + " " + cpu_flags + " -c -o '"+out_ob+"' '"+f+"'";
+        obj_list += " '"+out_ob+"'";
+        if (force || should_rebuild(out_ob, file_mtime(f))) jobs.push_back(cmd);
+    }
+    for(auto f: asm_files) {
+        string out_ob = bdir + flatten_filename(f) + ".asm.o";
+        string cmd = asm_compiler + " -f"+asm_fmt+" -o '"+out_ob+"' " + user_asmflags;
+        obj_list += " '"+out_ob+"'";
+        if (force || should_rebuild(out_ob, file_mtime(f))) jobs.push_back(cmd);
+    }
+    if (jobs.size()) relink = true;
+    return run_jobs(jobs);
+}
+
+static string json_string(string s) {
+    string out = "\"";
+    for(auto c: s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 32) continue;
+        out += c;
+    }
+    return out + "\"";
+}
+
+// /OPTREPORT: the compiler's vectorizer and inliner remarks (already pointing at .au lines through
+// #line) are de-duplicated and grouped by the .au function they fall in.
+static string optreport_json(int& vectorized, int& missed) {
+    struct Remark {
+        string file, func;
+        int line;
+        bool optimized;
+        string msg;
+        bool operator<(const Remark& b) const {
+            if (file != b.file) return file < b.file;
+            if (line != b.line) return line < b.line;
+            if (optimized != b.optimized) return optimized;
+            return msg < b.msg;
+        }
+    };
+    set<Remark> remarks;
+    for(auto& r: opt_reports) {
+        string text = read_file(r.second), line;
+        for(auto c: text) {
+            if (c != '\n') {
+                line += c;
+                continue;
+            }
+            // file:line:col: kind: message
+            size_t a = line.find(':');
+            while (a != string::npos && !(a + 1 < line.size() && isdigit(line[a+1]))) a = line.find(':', a+1);
+            size_t b = a == string::npos ? a : line.find(": ", a+1);
+            size_t k = b == string::npos ? b : line.find(": ", b+2);
+            if (k != string::npos) {
+                Remark rm;
+                rm.file = line.substr(0, a);
+                rm.line = atoi(line.c_str() + a + 1);
+                string kind = line.substr(b+2, k-b-2);
+                rm.msg = trim(line.substr(k+2));
+                rm.optimized = kind == "optimized";
+                if (kind == "remark") {
+                    rm.optimized = rm.msg.find("[-Rpass=") != string::npos;
+                    auto tag = rm.msg.rfind(" [-R");
+                    if (tag != string::npos) rm.msg = rm.msg.substr(0, tag);
                 }
-            }
-            int isStatic = 0;
-            if (code.find("static ") == 0) {
-                isStatic = 1;
-                code = code.substr(6);
-                while (code.size() && isspace(code[0])) {
-                    code = code.substr(1);
+                if (kind == "optimized" || kind == "missed" || kind == "remark") {
+                    if (rm.file == r.first->filename) {
+                        for(auto& fs: r.first->functions) {
+                            if (!fs.isData && rm.line >= fs.first_line && rm.line <= fs.last_line) rm.func = fs.name;
+                        }
+                    }
+                    remarks.insert(rm);
                 }
             }
-            auto memberHint = code.find("::");
-            int isMember = (memberHint != string::npos);
-            if (isMember) {
-                string obj = read_symbol_backwards(code, memberHint);
-                if (obj.size()) {
-                    var_type_table["this"] = obj+"*";
-                    symbol_flags[obj] |= 4 + 8;
-                } else {
-                    fprintf(stderr, HILITE "%s:%d: " WARNING_STYLE "warning:" REGGS " failed to deduce type for 'this'\n", filename.c_str(), line_no);
+            line = "";
+        }
+    }
+    // a loop counts as vectorized when any version of it was (gcc also reports the scalar epilogue as missed)
+    map<pair<string,int>, int> loops;
+    for(auto& rm: remarks) {
+        bool vec = rm.msg.find("vectorized") != string::npos && rm.msg.find("not vectorized") == string::npos;
+        if (rm.msg.find("vectoriz") == string::npos) continue;
+        int& st = loops[make_pair(rm.file, rm.line)];
+        if (rm.optimized && vec) st = 1;
+        else if (!st) st = -1;
+    }
+    vectorized = missed = 0;
+    for(auto& l: loops) {
+        if (l.second > 0) vectorized++;
+        else missed++;
+    }
+    string out = "{\n  \"functions\": [";
+    string cur_file, cur_func;
+    bool first = true;
+    for(auto& rm: remarks) {
+        if (first || rm.file != cur_file || rm.func != cur_func) {
+            if (!first) out += "\n      ]\n    },";
+            out += "\n    {\n      \"file\": " + json_string(rm.file) + ",\n      \"function\": " + json_string(rm.func) + ",\n      \"remarks\": [";
+            cur_file = rm.file;
+            cur_func = rm.func;
+            first = true;
+        } else {
+            out += ",";
+        }
+        first = false;
+        bool vec = rm.msg.find("vectoriz") != string::npos;
+        string loop = !vec ? "" : loops[make_pair(rm.file, rm.line)] > 0 ? ", \"loop\": \"vectorized\"" : ", \"loop\": \"missed\"";
+        out += "\n        {\"line\": " + to_string(rm.line) + ", \"kind\": \"" + (rm.optimized ? "optimized" : "missed") + "\"" + loop + ", \"message\": " + json_string(rm.msg) + "}";
+    }
+    if (remarks.size()) out += "\n      ]\n    }\n  ";
+    out += "],\n  \"loops_vectorized\": " + to_string(vectorized) + ",\n  \"loops_missed\": " + to_string(missed) + "\n}\n";
+    return out;
+}
+
+static string link_command(string output, string obj_list, string ldflags) {
+    string cmd = linker + " -o '"+output+"' "+obj_list+" "+ldflags + " " + user_ldflags;
+    for(auto l: libs) cmd += " -l"+l;
+    return cmd;
+}
+
+static int link_output(string output, string obj_list, string ldflags) {
+    if (!linker.size()) {
+        fprintf(stderr, ERROR_STYLE "error:" REGGS " no linker found, please specify with /LD:{your-linker}\n");
+        return 1;
+    }
+    string cmd = link_command(output, obj_list, ldflags);
+    if (!quiet) printf("%s\n", cmd.c_str());
+    return system(cmd.c_str());
+}
+
+// prefix of the per-configuration object directories: /LAYOUT changes struct layouts in every
+// header, so its objects must never be mixed with ones compiled without it
+static string target_dir() {
+    return build_dir + os + (layout_mode ? "-layout" : "");
+}
+
+// whether the output can run on the machine auc runs on
+static bool host_runnable() {
+#ifdef _WIN32
+    return os == "windows";
+#else
+    return os != "windows";
+#endif
+}
+
+// /AUTOTUNE: each flag variant builds in its own <os>-tune<N> directory, so trying them again only
+// recompiles what changed, and is linked to the output path and timed with the user's command.
+// The fastest is recorded in autotune.txt and reused by later builds until the command changes.
+static int autotune(string& bdir, string& cflags, string& ldflags, string include_list, string obj_list, string output, bool& relink) {
+    string current = " " + release_flags + " " + cpu_flags;
+    vector<string> labels, variants;
+    labels.push_back("default");
+    variants.push_back(current);
+    // -march=native output only runs on CPUs like this one, so it's never picked unless asked for
+    if (autotune_native && host_runnable() && cpu_flags.size()) {
+        labels.push_back("native");
+        variants.push_back(" " + release_flags + " -march=native");
+    }
+    string polyhedral = " -fgraphite-identity -ftree-loop-distribution -floop-nest-optimize";
+    if (release_flags.find(polyhedral.substr(1)) != string::npos) {
+        labels.push_back("no-graphite");
+        variants.push_back(str_replace(current, polyhedral, ""));
+    }
+    labels.push_back("unroll");
+    variants.push_back(" " + release_flags + " -funroll-loops " + cpu_flags);
+    if (release_flags.find("-Ofast") != string::npos) {
+        labels.push_back("O2");
+        variants.push_back(str_replace(current, "-Ofast", "-O2"));
+    }
+    string rec = build_dir + "autotune.txt";
+    string saved = read_file(rec);
+    string key = "command: " + autotune_command + "\nnative: " + (autotune_native ? "yes" : "no") + "\n";
+    int chosen = -1;
+    if (saved.find(key) == 0) {
+        auto at = saved.find("chosen: ");
+        string label = at == string::npos ? "" : saved.substr(at + 8, saved.find('\n', at) - at - 8);
+        for(int i=0;i<labels.size();i++) {
+            if (labels[i] == label) chosen = i;
+        }
+    }
+    if (chosen < 0) {
+        string table;
+        double best = 0, best_spread = 0;
+        for(int i=0;i<labels.size();i++) {
+            string vdir = target_dir() + "-tune" + to_string(i) + "/";
+            mkdir(vdir.c_str(), 0777);
+            string list = obj_list;
+            bool unused = false;
+            int r = build_objects(vdir, str_replace(cflags, current, variants[i]), include_list, false, list, unused);
+            if (r) return r;
+            r = link_output(output, list, str_replace(ldflags, current, variants[i]));
+            if (r) return r;
+            double runs[3];
+            for(int k=0;k<3;k++) {
+                if (!quiet) printf("%s\n", autotune_command.c_str());
+                auto t0 = chrono::steady_clock::now();
+                r = system(autotune_command.c_str());
+                runs[k] = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+                if (r) {
+                    fprintf(stderr, ERROR_STYLE "error:" REGGS " autotune command returned code %d\n", r);
+                    return r;
                 }
             }
-            string hcode = resolve_member_functions(code, 1, isStatic, isConst, isCustom, var_type_table);
-            extract_public_signatures(head, post_head, public_post_head, public_csv, local_post_head, local_head, hcode, isPacked, isPublic, isPrivate, isOpaque);
-            string err = extract_variable_types(code, var_type_table, symbol_flags, tail.size());
-            if (err.size()) {
-                fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
-                return false;
-            }
-            rewrite_structs(code, head, public_head, public_csv, local_head, tail, space, &outputToHeader, isPacked, isPublic, isOpaque, isPrivate, symbol_flags);
-            rewrite_enums(code, head, public_head, public_csv, local_head, tail, space, &outputToHeader, isPublic, isOpaque, isPrivate);
-            err = rewrite_member_calls(code, var_type_table);
-            if (err.size()) {
-                fprintf(stderr, HILITE "%s:%d: " ERROR_STYLE "error:" REGGS " %s\n", filename.c_str(), line_no, err.c_str());
-                return false;
-            }
-            if (isMember) {
-                code = resolve_member_functions(code, 0, isStatic, isConst, isCustom, var_type_table);
-            }
-            if (isStatic && !isMember) code = "static " + code;
-            if (isConst && !isMember) code = "const " + code;
-            int oth = outputToHeader;
-            if (tail.size() && (code == "}" || code == "};")) {
-                code = tail;
-                tail = "";
-                outputToHeader = 0;
-            }
-            code = space + code + "\n";
-            if (oth == 1) {
-                head += code;
-                public_head += code;
-                public_csv.push_back("\x01" + code);
-                //local_head += code;
-            } else if (oth == 2) {
-                head += code;
-                //local_head += code;
-            } else if (oth == 3) {
-                local_head += code;
-            } else {
-                body += line_directive(code, human, line_no, filename);
-                //body += code;
-                code = "";
+            double lo = runs[0] < runs[1] ? runs[0] : runs[1], hi = runs[0] < runs[1] ? runs[1] : runs[0];
+            double median = runs[2] < lo ? lo : runs[2] > hi ? hi : runs[2];
+            double spread = max(runs[0], max(runs[1], runs[2])) - min(runs[0], min(runs[1], runs[2]));
+            printf("/AUTOTUNE: %-12s %10.4fs  +- %.4fs\n", labels[i].c_str(), median, spread / 2);
+            table += labels[i] + "\t" + to_string(median) + "\t" + to_string(spread) + "\t" + trim(variants[i]) + "\n";
+            // a variant has to beat the current pick by more than either one's run-to-run spread
+            // (and by 3% at least), otherwise the difference is noise and the earlier one stays
+            double margin = max(max(spread, best_spread), best * 0.03);
+            if (chosen < 0 || median < best - margin) {
+                chosen = i;
+                best = median;
+                best_spread = spread;
             }
         }
-        return true;
+        string report = key + "chosen: " + labels[chosen] + "\nflags: " + trim(variants[chosen]) + "\n\n" + table;
+        if (!write_file(rec, report)) {
+            fprintf(stderr, WARNING_STYLE "warning:" REGGS " failed to write %s\n", rec.c_str());
+        }
+        // the output was last linked with the last variant
+        relink = true;
     }
-};
+    if (!quiet) printf("/AUTOTUNE: using %s (%s)\n", labels[chosen].c_str(), trim(variants[chosen]).c_str());
+    if (labels[chosen] == "native") {
+        fprintf(stderr, WARNING_STYLE "warning:" REGGS " /AUTOTUNE picked -march=native, the output may not run on other CPUs (SIGILL)\n");
+    }
+    bdir = target_dir() + "-tune" + to_string(chosen) + "/";
+    mkdir(bdir.c_str(), 0777);
+    cflags = str_replace(cflags, current, variants[chosen]);
+    ldflags = str_replace(ldflags, current, variants[chosen]);
+    return 0;
+}
 
-void set_rebuild_recursive(SourceFile* f) {
-    if (f->rebuild) return;
-    f->rebuild = true;
-    for(auto d: f->exports_to) {
-        set_rebuild_recursive(d);
+// /BENCH: the program's objects are linked again with a generated runner whose __wrap_main takes
+// over main(), so the #bench functions are measured in exactly the code the program ships.
+// The real main() stays reachable through a volatile pointer: if it were dead, LTO would treat the
+// globals it writes as constants and fold the measured functions away.
+static int build_bench(string bdir, string cflags, string ldflags, string include_list, string obj_list, string output) {
+    if (dll_mode) {
+        fprintf(stderr, ERROR_STYLE "error:" REGGS " /BENCH needs an executable build\n");
+        return 1;
+    }
+    string src = "// generated by auc for /BENCH\n" + include_list;
+    src += "static void au_bench_escape(void* p) {__asm__ volatile(\"\" : : \"r\"(p) : \"memory\");}\n";
+    src += "int __real_main(int argc, char** argv);\n";
+    src += "int (* volatile au_bench_main)(int, char**) = __real_main;\n";
+    string table;
+    int count = 0;
+    for(int i=0;i<bench_cases.size();i++) {
+        auto& b = bench_cases[i];
+        string arg = b.param.size() ? b.param : "au_arg";
+        string call = b.func + "(" + (b.param.size() ? "(" + arg + ")" : "") + ")";
+        string id = to_string(i);
+        src += "static void au_bench_run" + id + "(u64 " + arg + ") {";
+        if (!b.param.size()) src += "(void)" + arg + "; ";
+        else src += "__asm__ volatile(\"\" : \"+r\"(" + arg + ")); ";
+        if (b.isVoid) src += call + ";}\n";
+        else src += "__typeof__(" + call + ") r = " + call + "; au_bench_escape(&r);}\n";
+        string bytes = "0";
+        if (b.bytes.size()) {
+            src += "#line " + to_string(b.line) + " \"" + b.file + "\"\n";
+            src += "static f64 au_bench_bytes" + id + "(u64 " + arg + ") {(void)" + arg + "; return (f64)(" + b.bytes + ");}\n";
+            bytes = "au_bench_bytes" + id;
+        }
+        vector<string> values = b.values;
+        if (!values.size()) values.push_back("0");
+        for(auto v: values) {
+            string name = b.param.size() ? b.func + "(" + b.param + "=" + v + ")" : b.func;
+            table += "    {\"" + name + "\", au_bench_run" + id + ", (u64)(" + v + "), " + bytes + "},\n";
+            count++;
+        }
+    }
+    if (!count) {
+        fprintf(stderr, WARNING_STYLE "warning:" REGGS " /BENCH: no #bench functions found\n");
+        return 0;
+    }
+    src += "static const au_bench au_bench_cases[] = {\n" + table + "};\n";
+    src += "int __wrap_main(int argc, char** argv) {\n";
+    src += "    if (!au_bench_main) return 1;\n";
+    src += "    return au_bench_run(argc, argv, au_bench_cases, " + to_string(count) + ");\n}\n";
+    string runner = bdir + "au_bench.c", runner_ob = bdir + "au_bench.o";
+    bool changed = read_file(runner) != src;
+    if (changed && !write_file(runner, src)) {
+        fprintf(stderr, ERROR_STYLE "error:" REGGS " failed to write file %s\n", runner.c_str());
+        return 1;
     }
+    if (changed || file_mtime(runner_ob) < 0) {
+        string cmd = compiler + " -c -o '"+runner_ob+"' '"+runner+"' " + cflags + " " + user_auflags;
+        if (!quiet) printf("%s\n", cmd.c_str());
+        if (system(cmd.c_str())) return 1;
+        changed = true;
+    }
+    string bench_out = output;
+    if (exeext.size() && bench_out.size() > exeext.size() && bench_out.substr(bench_out.size() - exeext.size()) == exeext) {
+        bench_out = bench_out.substr(0, bench_out.size() - exeext.size());
+    }
+    bench_out += "_bench" + exeext;
+    if (changed || file_mtime(bench_out) < file_mtime(output)) {
+        int r = link_output(bench_out, obj_list + " '"+runner_ob+"'", ldflags + " -Wl,--wrap=main");
+        if (r) return r;
+    }
+    if (!host_runnable()) {
+        printf("/BENCH: built %s\n", bench_out.c_str());
+        return 0;
+    }
+    // a bare name would be looked up in PATH
+    string cmd = string("'") + (bench_out.find('/') == string::npos ? "./" : "") + bench_out + "' --json '" + build_dir + "bench.json'";
+    if (bench_baseline.size()) cmd += " --baseline '" + bench_baseline + "'";
+    if (!quiet) printf("%s\n", cmd.c_str());
+    int r = system(cmd.c_str());
+    if (r) fprintf(stderr, ERROR_STYLE "error:" REGGS " /BENCH: %s\n", bench_baseline.size() ? "regression against the baseline" : "benchmark runner failed");
+    return r ? 1 : 0;
+}
+
+static long newest_source_mtime() {
+    long t = -1;
+    for(auto f: files) t = max(t, file_mtime(f->filename));
+    for(auto f: c_files) t = max(t, file_mtime(f));
+    for(auto f: cpp_files) t = max(t, file_mtime(f));
+    for(auto f: asm_files) t = max(t, file_mtime(f));
+    return t;
 }
 
 int usage() {
     printf("usage: auc <input files>\n");
     printf("\t/OUT:<output-filename> (-o)\n");
     printf("\t/DEBUG (-g)\n");
+    printf("\t/DEV\n");
     printf("\t/DIR:<build-directory> (-d)\n");
     printf("\t/OS:<operating-system> (-m) [linux, windows, win32]\n");
     printf("\t/DLL (-shared)\n");
     printf("\t/VERBOSE (-v)\n");
     printf("\t/HELP (-h)\n");
     printf("\t/PRETTY\n");
+    printf("\t/PRUNE\n");
+    printf("\t/LAYOUT\n");
+    printf("\t/OPTREPORT\n");
+    printf("\t/BENCH[:<baseline.json>]\n");
+    printf("\t/NO-OPENMP\n");
+    printf("\t/CSFAST\n");
+    printf("\t/SHARD:<lines>|<size>{b,kb,mb}\n");
+    printf("\t/JOBS:<count> (-j)\n");
+    printf("\t/PGO:<training-command> (--pgo)\n");
+    printf("\t/AUTOTUNE:<benchmark-command> (--autotune)\n");
+    printf("\t/AUTOTUNE-NATIVE (--autotune-native)\n");
     return 0;
 }
 
@@ -1244,12 +4232,24 @@ int help() {
     printf("usage: auc <input files> [options] [more input files]\n\nSupported input types:\n\t.au (Austere)\n\t.cs (C#)\n\t.c, .cpp (C/C++)\n\t.dll, .so, .o (Libraries)\n\t.ico, .rc, .res, .manifest (Resources)\n\n");
     printf("/OUT:<output-filename> (-o)\n\n");
     printf("/DEBUG (-g)\n\n");
+    printf("/DEV\n * Fast-iteration debug build: no LTO, split DWARF, and mold/lld when installed.\n\n");
     printf("/DIR:<build-directory> (-d)\n * Intermediate compile results (generated .o .c and .h files)\n\n");
     printf("/OS:<operating-system> (-m)\n * Any cross compiler toolchain (eg. 'x86_64-w64-mingw32')\n   or a preset: 'linux', 'windows' (aka 'win64'), 'win32'\n\n");
-    printf("/DLL (-shared)\n * Produce a .dll file instead of an .exe file.\n   (WARNING: Writes *.dll.h and *.dll.cs in the same dir as the .dll file)\n\n");
+    printf("/DLL (-shared)\n * Produce a .dll file instead of an .exe file.\n   (WARNING: Writes *.dll.h and *.dll.cs in the same dir as the .dll file)\n   On Linux the .au files only export their public/opaque functions, through a generated\n   version script; linked .c/.cpp/asm objects keep their exports.\n\n");
     printf("/VERBOSE (-v)\n * Show the sub-commands being executed.\n\n");
     printf("/HELP (-h)\n * Show this help screen.\n\n");
     printf("/PRETTY\n * Generate pretty .c files from .au sources\n   (Ruins compiler and debugger messages, only meant as an escape hatch.) \n\n");
+    printf("/PRUNE\n * Leave functions that are unreachable from main() or the DLL exports out of the\n   generated .c files. Reports what was removed (per function with /VERBOSE).\n\n");
+    printf("/LAYOUT\n * Reorder the fields of non-public, non-packed structs to remove padding ('hot' fields\n   first, then by alignment) and write a pahole-style report to <build-directory>/layout.txt.\n   (Breaks positional initializers like {1, 2} for the reordered structs.)\n   Objects are kept in their own <os>-layout-* directories.\n\n");
+    printf("/OPTREPORT\n * Collect the compiler's vectorization and inlining remarks for every .au file, mapped to\n   .au lines and functions, into <build-directory>/optreport.json. Builds without LTO, in\n   its own <os>-optreport directory.\n\n");
+    printf("/BENCH[:<baseline.json>]\n * Link the #bench functions into <output>_bench with a runner that pins a CPU, calibrates\n   and reports the median and MAD of ns/op (and B/op, GB/s with bytes=), then run it and write\n   <build-directory>/bench.json. With a baseline (an earlier bench.json) a case that got more\n   than 5%% slower, beyond the measured noise, fails the build. '#bench n=64,4096 bytes=n*4' sweeps n.\n\n");
+    printf("/NO-OPENMP\n * Build without OpenMP: 'parallel for' loops run on the work-stealing thread pool in\n   austere_rt.c instead (AU_THREADS sets the thread count). Locals used in the loop body\n   are captured by pointer, so local arrays must be accessed through a pointer.\n\n");
+    printf("/CSFAST\n * Generate the .dll.cs bindings as unmanaged function pointers resolved once at load\n   (needs C# 9 / .NET 5 and AllowUnsafeBlocks) instead of marshalled [DllImport]s. Parameters\n   are blittable: pointers stay pointers, and 'const char*' also gets a ReadOnlySpan<byte>\n   overload for NUL-terminated UTF-8 (\"text\"u8). Functions declared 'fast' skip the GC\n   transition ([SuppressGCTransition]): keep them short, non-blocking and free of callbacks.\n\n");
+    printf("/SHARD:<lines>|<size>{b,kb,mb}\n * Split .au files longer than the threshold into several translation units\n   at function boundaries, so they compile in parallel.\n\n");
+    printf("/JOBS:<count> (-j)\n * Number of parallel compile jobs. Objects are compiled in parallel by default, one job\n   per CPU; /JOBS:1 compiles one at a time (eg. to read errors in order).\n\n");
+    printf("/PGO:<training-command> (--pgo)\n * Profile-guided build: an instrumented build is linked to the output path and the\n   training command is run against it, then everything is rebuilt with the profile.\n   Profiles live in <build-directory>/pgo/ and are reused until the sources change.\n\n");
+    printf("/AUTOTUNE:<benchmark-command> (--autotune)\n * Release builds only: each compiler flag variant is built in its own <os>-tune<N> directory,\n   linked to the output path and timed with the benchmark command (median of 3 runs). The\n   fastest is written to <build-directory>/autotune.txt and used until the command changes\n   (delete the file to tune again). A variant replaces an earlier one only when it's faster by\n   more than the run-to-run spread (and at least 3%%).\n\n");
+    printf("/AUTOTUNE-NATIVE (--autotune-native)\n * Let /AUTOTUNE try -march=native too. The result may only run on CPUs like the build host.\n\n");
     printf("-I, -D, -L, -l\n * Passed through to the compiler or linker.\n\n");
     return 0;
 }
@@ -1284,7 +4284,7 @@ int main(int argc, char** argv) {
             if (last_flag[0] == '-') {
                 auto co = last_flag.find('=');
                 if (co != string::npos) {
-                    arg = last_flag.substr(co+1);
+                    arg = string(argv[i]).substr(co+1);
                     argl = lowercase(arg);
                     last_flag = last_flag.substr(0, co);
                 }
@@ -1292,7 +4292,7 @@ int main(int argc, char** argv) {
             if (last_flag[0] == '/') {
                 auto co = last_flag.find(':');
                 if (co != string::npos) {
-                    arg = last_flag.substr(co+1);
+                    arg = string(argv[i]).substr(co+1);
                     argl = lowercase(arg);
                     last_flag = last_flag.substr(0, co);
                 }
@@ -1341,6 +4341,11 @@ int main(int argc, char** argv) {
             cpp_compiler = arg;
             last_flag = "";
             continue;
+        } else if (last_flag == "--host-compiler" || last_flag == "/hostcc") {
+            if (!arg.size()) continue;
+            host_compiler = arg;
+            last_flag = "";
+            continue;
         } else if (last_flag == "--cs-compiler" || last_flag == "/cs") {
             if (!arg.size()) continue;
             cs_compiler = arg;
@@ -1382,6 +4387,57 @@ int main(int argc, char** argv) {
             debug_mode = true;
             last_flag = "";
             continue;
+        } else if (last_flag == "/shard") {
+            if (!arg.size()) continue;
+            long n = atol(argl.c_str());
+            if (argl.find("mb") != string::npos) shard_bytes = n * 1024 * 1024;
+            else if (argl.find("kb") != string::npos) shard_bytes = n * 1024;
+            else if (argl.find('b') != string::npos) shard_bytes = n;
+            else shard_lines = n;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "-j" || last_flag == "/jobs") {
+            if (!arg.size()) continue;
+            max_jobs = atoi(arg.c_str());
+            last_flag = "";
+            continue;
+        } else if (last_flag.size() > 2 && last_flag.substr(0, 2) == "-j") {
+            max_jobs = atoi(last_flag.substr(2).c_str());
+            last_flag = "";
+            continue;
+        } else if (last_flag == "/prune") {
+            prune_mode = true;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "/no-openmp") {
+            openmp_mode = false;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "/csfast") {
+            csfast_mode = true;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "/bench") {
+            bench_mode = true;
+            bench_baseline = arg;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "/optreport") {
+            optreport_mode = true;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "--autotune-native" || last_flag == "/autotune-native") {
+            autotune_native = true;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "/layout") {
+            layout_mode = true;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "/dev") {
+            dev_mode = true;
+            last_flag = "";
+            continue;
         } else if (last_flag == "-shared" || last_flag == "/dll") {
             dll_mode = true;
             last_flag = "";
@@ -1394,6 +4450,16 @@ int main(int argc, char** argv) {
             human = true;
             last_flag = "";
             continue;
+        } else if (last_flag == "--autotune" || last_flag == "/autotune") {
+            if (!arg.size()) continue;
+            autotune_command = arg;
+            last_flag = "";
+            continue;
+        } else if (last_flag == "--pgo" || last_flag == "/pgo") {
+            if (!arg.size()) continue;
+            pgo_command = arg;
+            last_flag = "";
+            continue;
         }
         if (!output.size()) {
             auto_output = true;
@@ -1429,6 +4495,7 @@ int main(int argc, char** argv) {
         if (os == "win32") {
             os = "i686";
             cpu_flags = "-march=k6 -mtune=k8";
+            pointer_size = 4;
             asm_fmt = "elf";
             //systag = "_x86";
         } else {
@@ -1441,12 +4508,16 @@ int main(int argc, char** argv) {
         resource_compiler = os + "-w64-mingw32-windres";
         ldflags += " -Wl,--subsystem,windows -mwindows";
         cflags += " -DOS_WINDOWS";
+        dev_flags = str_replace(dev_flags, " -gsplit-dwarf", "");
         os = "windows";
         dllext = ".dll";
         exeext = ".exe";
     } else if (os == "linux" || os == "lin32" || os == "lin64" || os == "lin") {
         if (os == "lin32") {
             cpu_flags = "-m32 -march=k6 -mtune=k8";
+            pointer_size = 4;
+            // i386 SysV only aligns 8-byte scalars to 4 inside structs
+            wide_align = 4;
             asm_fmt = "elf";
             //systag = "_x86";
         } else {
@@ -1454,10 +4525,20 @@ int main(int argc, char** argv) {
         }
         cflags += " -DOS_LINUX";
         os = "linux";
+        // only /DEV links with them, so don't spawn the probes for other builds
+        const char* fast_linkers[] = {"mold", "lld", "gold", 0};
+        for(int i=0;dev_mode && fast_linkers[i];i++) {
+            string test = string("which ") + (strcmp(fast_linkers[i], "mold") ? "ld." : "") + fast_linkers[i] + " 2>/dev/null >/dev/null";
+            if (!system(test.c_str())) {
+                dev_ldflags = string(" -fuse-ld=") + fast_linkers[i] + " -Wl,--gdb-index";
+                break;
+            }
+        }
     } else {
         cpu_flags = "";
         release_flags = "-O2";
         debug_flags = "-g";
+        dev_flags = "-g";
         string test, cmd;
         const char* tries[] = {"-cc", "-gcc", 0};
         for(int i=0;tries[i];i++) {
@@ -1468,6 +4549,9 @@ int main(int argc, char** argv) {
                 linker = cmd;
             }
         }
+        const char* narrow[] = {"i386-", "i486-", "i586-", "i686-", "arm-", "mips-", "mipsel-", "powerpc-", 0};
+        for(int i=0;narrow[i];i++) if (os.find(narrow[i]) == 0) pointer_size = 4;
+        if (pointer_size == 4 && os[0] == 'i' && os.find("mingw") == string::npos) wide_align = 4;
     }
     if (!compiler.size() && !system("which cc 2>/dev/null >/dev/null")) compiler = "cc";
     if (!compiler.size() && !system("which gcc 2>/dev/null >/dev/null")) compiler = "gcc";
@@ -1512,16 +4596,69 @@ int main(int argc, char** argv) {
         }
         if (!ok) break;
     }
+    if (prune_mode) prune_unreachable();
     if (!(build_dir.size() >= 1 && build_dir[0] == '/') && (build_dir.size()<2 || build_dir.substr(0,2) != "./")) {
         build_dir = "./"+build_dir;
     }
     mkdir(build_dir.c_str(), 0777);
-    string bdir = build_dir + os + (debug_mode ? "-debug/" : "-release/");
+    if (layout_mode && !write_file(build_dir + "layout.txt", layout_report())) {
+        fprintf(stderr, WARNING_STYLE "warning:" REGGS " failed to write %slayout.txt\n", build_dir.c_str());
+    }
+    string bdir = target_dir() + (debug_mode ? "-debug/" : "-release/");
+    if (dev_mode) bdir = target_dir() + "-dev/";
+    if (optreport_mode) bdir = target_dir() + "-optreport/";
+    if (pgo_command.size()) bdir = target_dir() + "-pgo/";
     cflags += " -I'"+bdir+"'";
     mkdir(bdir.c_str(), 0777);
+    // runtime entry points .au code calls directly, the rest are only reached through generated code
+    const char* runtime_calls[] = {"f16_to_f32_n", "f32_to_f16_n", "au_spawn", "au_run", 0};
+    if (bench_mode && bench_cases.size()) uses_runtime = true;
+    for(auto f: files) {
+        for(int i=0;runtime_calls[i];i++) {
+            if (f->top_refs.count(runtime_calls[i])) uses_runtime = true;
+            for(auto& fs: f->functions) {
+                if (fs.refs.count(runtime_calls[i])) uses_runtime = true;
+            }
+        }
+    }
+    for(auto& e: embeds) {
+        // only rewritten when the asset changes, so the object is only reassembled when needed
+        struct stat st;
+        stat(e.second.c_str(), &st);
+        bool coff = os == "windows";
+        // C symbols carry a leading underscore on Mach-O and 32-bit COFF only
+        string sym = (os == "apple" || (coff && compiler.find("i686") != string::npos)) ? "_" : "";
+        // as reads a backslash in a string as an escape, and takes / on Windows as well
+        string path = str_replace(e.second, "\\", "/");
+        path = str_replace(path, "\"", "\\\"");
+        string s = "/* " + e.second + " " + to_string((long long)st.st_size) + " " + to_string((long long)st.st_mtime) + " */\n";
+        s += coff ? "\t.section .rdata,\"dr\"\n" : os == "apple" ? "\t.const\n" : "\t.section .rodata\n";
+        s += "\t.globl " + sym + e.first + "\n\t.globl " + sym + e.first + "_len\n";
+        s += "\t.balign 16\n" + sym + e.first + ":\n\t.incbin \"" + path + "\"\n\t.byte 0\n";
+        s += "\t.balign 8\n" + sym + e.first + "_len:\n\t.quad " + to_string((long long)st.st_size) + "\n";
+        if (!coff && os != "apple") s += "\t.section .note.GNU-stack,\"\",@progbits\n";
+        string fn = bdir + "embed_" + e.first + ".s";
+        if (read_file(fn) != s && !write_file(fn, s)) {
+            fprintf(stderr, ERROR_STYLE "error:" REGGS " failed to write file %s\n", fn.c_str());
+            return 1;
+        }
+        embed_files.push_back(fn);
+    }
+    if (uses_runtime) {
+        string rt = bdir + "austere_rt.c";
+        string code((char*)austere_rt_c, austere_rt_c_len);
+        if (read_file(rt) != code && !write_file(rt, code)) {
+            fprintf(stderr, ERROR_STYLE "error:" REGGS " failed to write file %s\n", rt.c_str());
+            return 1;
+        }
+        c_files.push_back(rt);
+        ldflags += " -pthread";
+        if (os == "windows") ldflags += " -lws2_32";
+    }
     string gdir = build_dir + "generic/";
     mkdir(gdir.c_str(), 0777);
     string export_h, export_cs;
+    string cs_lib = strip_filename(output)+systag;
     for(auto f: files) {
         if (f->template_class.size()) continue;
         string file_id = str_replace(str_replace(f->filename, ".", "_"), "/", "_");
@@ -1531,6 +4668,10 @@ int main(int argc, char** argv) {
                 f->public_cs += translate_to_cs(csl.substr(1));
             } else if (csl.size() && csl[0] == 2) {
                 f->public_cs += translate_delegate(csl.substr(1));
+            } else if (csl.size() && csl[0] == 4) {
+                f->public_cs += translate_f16_binding(csl.substr(1));
+            } else if (csl.size() && csl[0] == 3) {
+                f->public_cs += translate_fast_binding(csl.substr(1));
             } else {
                 f->public_cs += csl;
             }
@@ -1598,7 +4739,20 @@ int main(int argc, char** argv) {
         string out_hname = strip_filename(f->filename);
         include_list += "#include \""+out_hname+".au.h\"\n";
     }
-    if (debug_mode) {
+    if (optreport_mode) {
+        // with LTO the vectorizer only runs at link time, where the remarks can't be collected per object
+        release_flags = str_replace(release_flags, "-flto=8 ", "");
+        debug_flags = str_replace(debug_flags, "-flto=8 ", "");
+    }
+    if (!openmp_mode) {
+        release_flags = str_replace(release_flags, "-fopenmp ", "");
+        debug_flags = str_replace(debug_flags, "-fopenmp ", "");
+        dev_flags = str_replace(dev_flags, "-fopenmp ", "");
+    }
+    if (dev_mode) {
+        cflags += " "+dev_flags+" "+cpu_flags;
+        ldflags += " "+dev_flags+" "+cpu_flags+dev_ldflags;
+    } else if (debug_mode) {
         cflags += " "+debug_flags+" "+cpu_flags;
         ldflags += " "+debug_flags+" "+cpu_flags;
     } else {
@@ -1649,9 +4803,43 @@ int main(int argc, char** argv) {
     if ((dll_mode || cs_files.size()) && os == "linux") {
         ldflags += " -Wl,-soname,'./"+extract_filename(output)+"'";
     }
+    if (dll_mode || cs_files.size()) {
+        cflags += " -ffunction-sections -fdata-sections -fno-semantic-interposition";
+        ldflags += " -Wl,--gc-sections";
+    }
 
     string obj_list;
     bool relink = false, native = files.size() || c_files.size() || cpp_files.size() || asm_files.size();
+    if ((dll_mode || cs_files.size()) && os == "linux") {
+        // only the public/opaque functions of the .au files go into the dynamic symbol table, their other
+        // globals (and the runtime's) are bound locally; linked .c/.cpp/asm objects keep what they export
+        string vscript = "{\n";
+        if (export_symbols.size()) {
+            vscript += "\tglobal:\n";
+            for(auto sym: export_symbols) vscript += "\t\t"+sym+";\n";
+        }
+        set<string> hidden;
+        for(auto f: files) {
+            if (f->template_class.size()) continue;
+            for(auto& fs: f->functions) {
+                if (fs.name.size() && !export_symbols.count(fs.name) && !(fs.isData && fs.isStatic)) hidden.insert(fs.name);
+            }
+        }
+        const char* runtime[] = {"au_*", "f16_to_f32_n", "f32_to_f16_n", 0};
+        for(int i=0;runtime[i];i++) hidden.insert(runtime[i]);
+        vscript += "\tlocal:\n";
+        for(auto sym: hidden) vscript += "\t\t"+sym+";\n";
+        vscript += "};\n";
+        string out_fn = bdir + strip_filename(output) + ".map";
+        if (read_file(out_fn) != vscript) {
+            if (!write_file(out_fn, vscript)) {
+                fprintf(stderr, ERROR_STYLE "error:" REGGS " failed to write file %s\n", out_fn.c_str());
+                return 1;
+            }
+            relink = true;
+        }
+        ldflags += " -Wl,--version-script='"+out_fn+"' -Wl,-z,now -Wl,-z,relro -Wl,--hash-style=gnu -Wl,-O1";
+    }
     if (dll_files.size()) {
         ldflags += " -Wl,-rpath,.";
     }
@@ -1675,69 +4863,6 @@ int main(int argc, char** argv) {
             }
         }
     }
-    for(auto f: files) {
-        string out_ob = bdir + flatten_filename(f->filename) + ".au.o";
-        if (should_rebuild(out_ob, file_mtime(f->filename))) {
-            set_rebuild_recursive(f);
-        }
-    }
-    for(auto f: files) {
-        if (f->template_class.size()) continue;
-        string file_id = str_replace(str_replace(f->filename, ".", "_"), "/", "_");
-        f->body = include_list + f->local_head + f->local_post_head + f->body;
-        string out_base = bdir + flatten_filename(f->filename);
-        string out_fn = out_base + ".au.c";
-        if (!write_file(out_fn, f->body)) {
-            fprintf(stderr, HILITE "%s: " ERROR_STYLE "error:" REGGS " failed to write file %s\n", f->filename.c_str(), out_fn.c_str());
-            return 1;
-        }
-        string out_ob = out_base + ".au.o";
-        string srcdir = extract_dir(f->filename);
-        string cmd = compiler + " -c -o '"+out_ob+"' '"+out_fn+"' -I'" + srcdir + "' " + cflags + " " + user_auflags;
-        obj_list += " '"+out_ob+"'";
-        if (f->rebuild) {
-            if (!quiet) printf("%s\n", cmd.c_str());
-            int r = system(cmd.c_str());
-            if (r) return r;
-            relink = true;
-        }
-    }
-    for(auto f: c_files) {
-        string file_id = str_replace(str_replace(f, ".", "_"), "/", "_");
-        string out_ob = bdir + flatten_filename(f) + ".c.o";
-        string cmd = compiler + " -c -o '"+out_ob+"' '"+f+"' " + cflags + " " + user_cflags;
-        obj_list += " '"+out_ob+"'";
-        if (should_rebuild(out_ob, file_mtime(f))) {
-            if (!quiet) printf("%s\n", cmd.c_str());
-            int r = system(cmd.c_str());
-            if (r) return r;
-            relink = true;
-        }
-    }
-    for(auto f: cpp_files) {
-        string file_id = str_replace(str_replace(f, ".", "_"), "/", "_");
-        string out_ob = bdir + flatten_filename(f) + ".cpp.o";
-        string cmd = cpp_compiler + " -c -o '"+out_ob+"' '"+f+"' " + cflags + " " + user_cppflags;
-        obj_list += " '"+out_ob+"'";
-        if (should_rebuild(out_ob, file_mtime(f))) {
-            if (!quiet) printf("%s\n", cmd.c_str());
-            int r = system(cmd.c_str());
-            if (r) return r;
-            relink = true;
-        }
-    }
-    for(auto f: asm_files) {
-        string file_id = str_replace(str_replace(f, ".", "_"), "/", "_");
-        string out_ob = bdir + flatten_filename(f) + ".asm.o";
-        string cmd = asm_compiler + " -f"+asm_fmt+" -o '"+out_ob+"' " + user_asmflags;
-        obj_list += " '"+out_ob+"'";
-        if (should_rebuild(out_ob, file_mtime(f))) {
-            if (!quiet) printf("%s\n", cmd.c_str());
-            int r = system(cmd.c_str());
-            if (r) return r;
-            relink = true;
-        }
-    }
     if (resource_compiler.size()) {
         if (!version.size()) {
             version = "0,0,0,0";
@@ -1811,15 +4936,75 @@ int main(int argc, char** argv) {
             }
         }
     }
-    if (relink || (native && (file_mtime(output) < 0))) {
-        if (!linker.size()) {
-            fprintf(stderr, ERROR_STYLE "error:" REGGS " no linker found, please specify with /LD:{your-linker}\n");
-            return 1;
+    if (autotune_command.size()) {
+        if (debug_mode || dev_mode || pgo_command.size()) {
+            fprintf(stderr, WARNING_STYLE "warning:" REGGS " /AUTOTUNE only applies to release builds without /PGO, ignored\n");
+        } else {
+            int r = autotune(bdir, cflags, ldflags, include_list, obj_list, output, relink);
+            if (r) return r;
         }
-        string cmd = linker + " -o '"+output+"' "+obj_list+" "+ldflags + " " + user_ldflags;
-        for(auto l: libs) cmd += " -l"+l;
-        if (!quiet) printf("%s\n", cmd.c_str());
-        int r = system(cmd.c_str());
+    }
+    string pgo_stamp;
+    if (pgo_command.size()) {
+        string pgo_dir = build_dir + "pgo/";
+        mkdir(pgo_dir.c_str(), 0777);
+        pgo_dir += strip_filename(real_output) + "/";
+        mkdir(pgo_dir.c_str(), 0777);
+        string stamp = pgo_dir + "profile.stamp";
+        bool train = (file_mtime(stamp) < newest_source_mtime()) || (read_file(stamp) != pgo_command);
+        if (train) {
+            string cmd = "rm -f '"+pgo_dir+"'*.gcda";
+            if (!quiet) printf("%s\n", cmd.c_str());
+            system(cmd.c_str());
+            string gen_flags = " -fprofile-generate='"+pgo_dir+"' -fprofile-update=atomic";
+            string gen_list = obj_list;
+            bool gen_relink = false;
+            int r = build_objects(bdir, cflags + gen_flags, include_list, true, gen_list, gen_relink);
+            if (r) return r;
+            r = link_output(output, gen_list, ldflags + gen_flags);
+            if (r) return r;
+            if (!quiet) printf("%s\n", pgo_command.c_str());
+            r = system(pgo_command.c_str());
+            if (r) {
+                fprintf(stderr, ERROR_STYLE "error:" REGGS " PGO training command returned code %d\n", r);
+                return r;
+            }
+            // stamped once the optimized build links, so a failed rebuild trains again next time
+            pgo_stamp = stamp;
+        }
+        string use_flags = " -fprofile-use='"+pgo_dir+"' -fprofile-partial-training -Wno-missing-profile";
+        cflags += use_flags;
+        ldflags += use_flags;
+        // instrumented objects share the optimized objects' paths, so the .gcda names match; rebuild them all after training
+        relink = relink || train;
+        int r = build_objects(bdir, cflags, include_list, train, obj_list, relink);
+        if (r) return r;
+    } else {
+        int r = build_objects(bdir, cflags, include_list, false, obj_list, relink);
+        if (r) return r;
+    }
+    if (optreport_mode) {
+        int vectorized, missed;
+        string rep = build_dir + "optreport.json";
+        if (!write_file(rep, optreport_json(vectorized, missed))) {
+            fprintf(stderr, WARNING_STYLE "warning:" REGGS " failed to write %s\n", rep.c_str());
+        }
+        printf("%d loops vectorized, %d not vectorized (see %s)\n", vectorized, missed, rep.c_str());
+    }
+    // the last link line is kept in bdir, so a changed object set or flag list relinks even when no object was rebuilt
+    string link_rec = bdir + "link.cmd";
+    string link_cmd = link_command(output, obj_list, ldflags);
+    if (relink || (native && ((file_mtime(output) < 0) || (read_file(link_rec) != link_cmd)))) {
+        int r = link_output(output, obj_list, ldflags);
+        if (r) return r;
+        write_file(link_rec, link_cmd);
+    }
+    if (pgo_stamp.size() && !write_file(pgo_stamp, pgo_command)) {
+        fprintf(stderr, ERROR_STYLE "error:" REGGS " failed to write file %s\n", pgo_stamp.c_str());
+        return 1;
+    }
+    if (bench_mode) {
+        int r = build_bench(bdir, cflags, ldflags, include_list, obj_list, output);
         if (r) return r;
     }
     string out_fn = output_base + ".dll.h";
@@ -1831,16 +5016,22 @@ int main(int argc, char** argv) {
     long exetime = file_mtime(output);
     long dllhtime = file_mtime(out_fn);
     long dllcstime = file_mtime(export_cs_file);
+    export_h = "#ifndef "+token2+"\n" + "#define "+token2+"\n" + export_h + "#endif\n";
+    export_h = remove_empty_ifdefs(export_h);
+    if (csfast_mode) {
+        string lib = "\tstatic readonly IntPtr au_lib = NativeLibrary.Load(\""+cs_lib+"\", typeof("+token2+").Assembly, null);\n";
+        export_cs = "using System;\nusing System.Runtime.InteropServices;\npublic static unsafe class "+token2+" {\n" + lib + export_cs + "}\n";
+    } else {
+        export_cs = "using System;\nusing System.Runtime.InteropServices;\npublic static class "+token2+" {\n" + export_cs + "}\n";
+    }
+    // flags like /CSFAST change the bindings without touching any source, so the text is compared too
     bool stale = (dllhtime < 0) || (dllcstime < 0) || (dllhtime < exetime) || (dllcstime < exetime);
+    if (!stale && (dll_mode || cs_files.size())) stale = read_file(out_fn) != export_h || read_file(export_cs_file) != export_cs;
     if (stale && (dll_mode || cs_files.size())) {
-        export_h = "#ifndef "+token2+"\n" + "#define "+token2+"\n" + export_h + "#endif\n";
-        export_h = remove_empty_ifdefs(export_h);
         if (!write_file(out_fn, export_h)) {
             fprintf(stderr, HILITE "%s: " ERROR_STYLE "error:" REGGS " failed to write file %s\n", token.c_str(), out_fn.c_str());
             return 1;
         }
-        
-        export_cs = "using System;\nusing System.Runtime.InteropServices;\npublic static class "+token2+" {\n" + export_cs + "}\n";
         if (!write_file(export_cs_file, export_cs)) {
             fprintf(stderr, HILITE "%s: " ERROR_STYLE "error:" REGGS " failed to write file %s\n", token.c_str(), export_cs_file.c_str());
             return 1;
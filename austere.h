@@ -10,13 +10,332 @@ typedef signed long long	i64;
 typedef signed int			i32;
 typedef signed short		i16;
 typedef signed char			i8;
+typedef i64                 s64;
+typedef i32                 s32;
+typedef i16                 s16;
+typedef i8                  s8;
 typedef double				f64;
 typedef float				f32;
+#if defined(__FLT16_MAX__) && !defined(AU_F16_STORAGE)
+typedef _Float16            f16;
+#else
 typedef unsigned short      f16;
+#endif
 typedef int                 bool;
 const static bool           false = 0;
 const static bool           true = 1;
 #define null 0
+
+/* Vector types. With GCC/Clang these are native vector extensions, so arithmetic and [] work
+ * directly and widths the target ISA lacks are split or scalarized by the compiler.
+ * Other compilers get a plain array struct; only the T_op() helpers work there.
+ * auc passes vector types by value to member calls: v.sum() becomes f32x4_sum(v). */
+#if defined(__GNUC__) || defined(__clang__)
+#define AU_VECTOR_TYPE(T, S, N) typedef S T __attribute__((vector_size(sizeof(S)*N)));
+#define AU_LANE(v, i) (v)[i]
+#else
+#define AU_VECTOR_TYPE(T, S, N) typedef struct { S v[N]; } T;
+#define AU_LANE(x, i) (x).v[i]
+#endif
+#if defined(__GNUC__) && !defined(__clang__)
+#define AU_SHUFFLE(T, N, v, m) return __builtin_shuffle(v, m);
+#else
+#define AU_SHUFFLE(T, N, v, m) T r; for(int i=0;i<N;i++) AU_LANE(r, i) = AU_LANE(v, AU_LANE(m, i) & (N-1)); return r;
+#endif
+/* Passing the 32-byte vectors by value makes GCC note an ABI change when AVX is off; that is
+ * expected for these static inline helpers, so -Wpsabi is silenced for the prelude only. */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+#define AU_VECTOR_OPS(T, S, N, M) \
+static inline T T##_load(const S* p) {T r; memcpy(&r, p, sizeof(r)); return r;} \
+static inline void T##_store(T v, S* p) {memcpy(p, &v, sizeof(v));} \
+static inline T T##_splat(S x) {T r; for(int i=0;i<N;i++) AU_LANE(r, i) = x; return r;} \
+static inline S T##_get(T v, int i) {return AU_LANE(v, i);} \
+static inline T T##_set(T v, int i, S x) {AU_LANE(v, i) = x; return v;} \
+static inline S T##_sum(T v) {S r = 0; for(int i=0;i<N;i++) r += AU_LANE(v, i); return r;} \
+static inline S T##_dot(T a, T b) {S r = 0; for(int i=0;i<N;i++) r += AU_LANE(a, i) * AU_LANE(b, i); return r;} \
+static inline S T##_hmin(T v) {S r = AU_LANE(v, 0); for(int i=1;i<N;i++) r = AU_LANE(v, i) < r ? AU_LANE(v, i) : r; return r;} \
+static inline S T##_hmax(T v) {S r = AU_LANE(v, 0); for(int i=1;i<N;i++) r = AU_LANE(v, i) > r ? AU_LANE(v, i) : r; return r;} \
+static inline T T##_min(T a, T b) {for(int i=0;i<N;i++) AU_LANE(a, i) = AU_LANE(b, i) < AU_LANE(a, i) ? AU_LANE(b, i) : AU_LANE(a, i); return a;} \
+static inline T T##_max(T a, T b) {for(int i=0;i<N;i++) AU_LANE(a, i) = AU_LANE(b, i) > AU_LANE(a, i) ? AU_LANE(b, i) : AU_LANE(a, i); return a;} \
+static inline T T##_shuffle(T v, M m) {AU_SHUFFLE(T, N, v, m)}
+AU_VECTOR_TYPE(i8x16, i8, 16)
+AU_VECTOR_TYPE(u8x16, u8, 16)
+AU_VECTOR_TYPE(i16x8, i16, 8)
+AU_VECTOR_TYPE(u16x8, u16, 8)
+AU_VECTOR_TYPE(i32x4, i32, 4)
+AU_VECTOR_TYPE(u32x4, u32, 4)
+AU_VECTOR_TYPE(i32x8, i32, 8)
+AU_VECTOR_TYPE(u32x8, u32, 8)
+AU_VECTOR_TYPE(i64x2, i64, 2)
+AU_VECTOR_TYPE(u64x2, u64, 2)
+AU_VECTOR_TYPE(i64x4, i64, 4)
+AU_VECTOR_TYPE(u64x4, u64, 4)
+AU_VECTOR_TYPE(f32x4, f32, 4)
+AU_VECTOR_TYPE(f32x8, f32, 8)
+AU_VECTOR_TYPE(f64x2, f64, 2)
+AU_VECTOR_TYPE(f64x4, f64, 4)
+AU_VECTOR_OPS(i8x16, i8, 16, i8x16)
+AU_VECTOR_OPS(u8x16, u8, 16, i8x16)
+AU_VECTOR_OPS(i16x8, i16, 8, i16x8)
+AU_VECTOR_OPS(u16x8, u16, 8, i16x8)
+AU_VECTOR_OPS(i32x4, i32, 4, i32x4)
+AU_VECTOR_OPS(u32x4, u32, 4, i32x4)
+AU_VECTOR_OPS(i32x8, i32, 8, i32x8)
+AU_VECTOR_OPS(u32x8, u32, 8, i32x8)
+AU_VECTOR_OPS(i64x2, i64, 2, i64x2)
+AU_VECTOR_OPS(u64x2, u64, 2, i64x2)
+AU_VECTOR_OPS(i64x4, i64, 4, i64x4)
+AU_VECTOR_OPS(u64x4, u64, 4, i64x4)
+AU_VECTOR_OPS(f32x4, f32, 4, i32x4)
+AU_VECTOR_OPS(f32x8, f32, 8, i32x8)
+AU_VECTOR_OPS(f64x2, f64, 2, i64x2)
+AU_VECTOR_OPS(f64x4, f64, 4, i64x4)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+/* Alignment. 'aligned(N) struct' and 'cacheline struct' put AU_ALIGNED on the struct, an
+ * 'isolated' field is wrapped in an anonymous AU_CACHELINE aligned struct so nothing else
+ * shares its line. auc assumes AU_CACHELINE is 64 when it computes C# StructLayout sizes.
+ * new/delete of over-aligned structs go through au_aligned_alloc/au_aligned_free. */
+#ifndef AU_CACHELINE
+#define AU_CACHELINE 64
+#endif
+#ifdef _MSC_VER
+#define AU_ALIGNED(N) __declspec(align(N))
+#define AU_ALIGNOF(T) __alignof(T)
+#else
+#define AU_ALIGNED(N) __attribute__((aligned(N)))
+#define AU_ALIGNOF(T) __alignof__(T)
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+static inline void* au_aligned_alloc(u64 size, u64 align) {return _aligned_malloc(size, align);}
+static inline void au_aligned_free(void* p) {_aligned_free(p);}
+#else
+static inline void* au_aligned_alloc(u64 size, u64 align) {void* p = 0; return posix_memalign(&p, align, size) ? 0 : p;}
+static inline void au_aligned_free(void* p) {free(p);}
+#endif
+
+/* Optimization hints. 'hot'/'cold' functions are emitted with AU_HOT/AU_COLD, which lets the
+ * compiler optimize them harder or for size and group them apart in .text. likely()/unlikely()
+ * mark the expected outcome of a condition. A 'noalias' parameter becomes 'restrict'. */
+#if defined(__GNUC__) || defined(__clang__)
+#define AU_HOT __attribute__((hot))
+#define AU_COLD __attribute__((cold))
+#ifndef likely
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#endif
+#else
+#define AU_HOT
+#define AU_COLD
+#ifndef likely
+#define likely(x) (x)
+#define unlikely(x) (x)
+#endif
+#endif
+
+/* Allocation backends for generated new/delete.
+ * arena: bump allocator, new(a) Foo(...) places a Foo in arena a; arena_reset() releases
+ * everything allocated from it at once, delete on such an object only runs Foo_delete().
+ * au_pool: per-thread free list used by 'pooled struct Foo', so new/delete of Foo never
+ * reach malloc/free after warmup. Memory is carved from AU_POOL_CHUNK object chunks and
+ * stays owned by the pool; an object freed on another thread joins that thread's list. */
+#ifdef _MSC_VER
+#define AU_THREAD_LOCAL __declspec(thread)
+#else
+#define AU_THREAD_LOCAL _Thread_local
+#endif
+#ifndef ARENA_BLOCK_SIZE
+#define ARENA_BLOCK_SIZE 65536
+#endif
+#ifndef AU_POOL_CHUNK
+#define AU_POOL_CHUNK 64
+#endif
+typedef struct arena_block {
+    struct arena_block* next;
+    u64 size, used;
+    u64 pad;
+} arena_block;
+typedef struct arena {
+    arena_block* block;
+    u64 block_size;
+} arena;
+static inline arena* arena_new(arena* self, u64 block_size) {
+    if (!self) self = (arena*)malloc(sizeof(arena));
+    if (!self) return 0;
+    self->block = 0;
+    self->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+    return self;
+}
+// align is a power of two; malloc only promises 16 bytes, so larger alignments are padded from the block's address
+static inline void* arena_alloc(arena* self, u64 size, u64 align) {
+    arena_block* b = self->block;
+    if (align < 16) align = 16;
+    size = (size + 15) & ~(u64)15;
+    u64 at = 0;
+    if (b) at = (((u64)(size_t)(b + 1) + b->used + align - 1) & ~(align - 1)) - (u64)(size_t)(b + 1);
+    if (!b || at + size > b->size) {
+        u64 need = size + align;
+        u64 cap = self->block_size > need ? self->block_size : need;
+        b = (arena_block*)malloc(sizeof(arena_block) + cap);
+        if (!b) return 0;
+        b->next = self->block;
+        b->size = cap;
+        b->used = 0;
+        self->block = b;
+        at = (((u64)(size_t)(b + 1) + align - 1) & ~(align - 1)) - (u64)(size_t)(b + 1);
+    }
+    void* p = (u8*)(b + 1) + at;
+    b->used = at + size;
+    return p;
+}
+static inline void arena_reset(arena* self) {
+    arena_block* b = self->block;
+    if (!b) return;
+    while (b->next) {
+        arena_block* n = b->next;
+        b->next = n->next;
+        free(n);
+    }
+    b->used = 0;
+}
+static inline void arena_delete(arena* self) {
+    while (self->block) {
+        arena_block* n = self->block->next;
+        free(self->block);
+        self->block = n;
+    }
+}
+typedef struct au_pool {
+    void* free;
+    u64 size, align;
+} au_pool;
+#define AU_POOL_INIT(T) {0, sizeof(T) < sizeof(void*) ? sizeof(void*) : sizeof(T), AU_ALIGNOF(T)}
+static inline void* au_pool_alloc(au_pool* pool) {
+    void* p = pool->free;
+    if (!p) {
+        u8* chunk = (u8*)malloc(pool->size * AU_POOL_CHUNK + pool->align);
+        if (!chunk) return 0;
+        chunk += (pool->align - (u64)chunk % pool->align) % pool->align;
+        for(int i=1;i<AU_POOL_CHUNK-1;i++) *(void**)(chunk + i*pool->size) = chunk + (i+1)*pool->size;
+        *(void**)(chunk + (AU_POOL_CHUNK-1)*pool->size) = 0;
+        p = chunk;
+        pool->free = chunk + pool->size;
+        return p;
+    }
+    pool->free = *(void**)p;
+    return p;
+}
+static inline void au_pool_free(au_pool* pool, void* p) {
+    if (!p) return;
+    *(void**)p = pool->free;
+    pool->free = p;
+}
+
+/* Half precision. Where the compiler has _Float16, f16 is a real arithmetic type (define
+ * AU_F16_STORAGE to keep the old bits-in-a-u16 meaning); elsewhere it's storage only and
+ * f16_to_f32()/f32_to_f16() convert, rounding to nearest even. Whole arrays should go through
+ * f16_to_f32_n()/f32_to_f16_n() in the runtime, which use F16C or AVX-512 when the CPU has them. */
+#if defined(__FLT16_MAX__) && !defined(AU_F16_STORAGE)
+static inline f32 f16_to_f32(f16 h) {return (f32)h;}
+static inline f16 f32_to_f16(f32 f) {return (f16)f;}
+#else
+static inline f32 f16_to_f32(f16 h) {
+    u32 sign = (u32)(h & 0x8000) << 16, exp = (h >> 10) & 0x1f, man = h & 0x3ff, bits = sign;
+    f32 f;
+    if (exp == 0x1f) bits |= 0x7f800000 | (man << 13);
+    else if (exp) bits |= ((exp + 112) << 23) | (man << 13);
+    else if (man) return sign ? -(f32)man / 16777216.0f : (f32)man / 16777216.0f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+static inline f16 f32_to_f16(f32 f) {
+    u32 x, sign, man, half, rem, mid;
+    i32 exp;
+    memcpy(&x, &f, 4);
+    sign = (x >> 16) & 0x8000;
+    exp = (i32)((x >> 23) & 0xff) - 112;
+    man = x & 0x7fffff;
+    if (((x >> 23) & 0xff) == 0xff) return (f16)(sign | 0x7c00 | (man ? 0x200 : 0));
+    if (exp >= 31) return (f16)(sign | 0x7c00);
+    if (exp <= 0) {
+        if (exp < -10) return (f16)sign;
+        man |= 0x800000;
+        half = man >> (14 - exp);
+        rem = man & ((1u << (14 - exp)) - 1);
+        mid = 1u << (13 - exp);
+    } else {
+        half = ((u32)exp << 10) | (man >> 13);
+        rem = man & 0x1fff;
+        mid = 0x1000;
+    }
+    if (rem > mid || (rem == mid && (half & 1))) half++;
+    return (f16)(sign | half);
+}
+#endif
+/* the raw bits, eg. for C# which passes Half by value differently than C passes _Float16 */
+static inline u16 f16_bits(f16 h) {u16 b; memcpy(&b, &h, 2); return b;}
+static inline f16 f16_from_bits(u16 b) {f16 h; memcpy(&h, &b, 2); return h;}
+
+/* wire structs are little-endian in memory; the accessors auc generates for them swap on
+ * big-endian hosts and compile to plain loads elsewhere. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define au_le16(x) __builtin_bswap16(x)
+#define au_le32(x) __builtin_bswap32(x)
+#define au_le64(x) __builtin_bswap64(x)
+#else
+#define au_le16(x) (x)
+#define au_le32(x) (x)
+#define au_le64(x) (x)
+#endif
+static inline f16 au_lef16(f16 x) {u16 b; memcpy(&b, &x, 2); b = au_le16(b); memcpy(&x, &b, 2); return x;}
+static inline f32 au_lef32(f32 x) {u32 b; memcpy(&b, &x, 4); b = au_le32(b); memcpy(&x, &b, 4); return x;}
+static inline f64 au_lef64(f64 x) {u64 b; memcpy(&b, &x, 8); b = au_le64(b); memcpy(&x, &b, 8); return x;}
+
+/* Self-relative pointers for persistent structs: the offset from the field to its target,
+ * 0 for null, so they stay valid wherever the heap file gets mapped. */
+typedef struct au_rel {i64 off;} au_rel;
+static inline void* au_rel_get(const au_rel* r) {return r->off ? (u8*)r + r->off : 0;}
+static inline void au_rel_set(au_rel* r, const void* p) {r->off = p ? (i64)((const u8*)p - (const u8*)r) : 0;}
+
+/* Runtime functions. auc compiles austere_rt.c into the build directory and links it
+ * only when the generated code calls into it. */
+void au_parallel_for(i64 count, i64 grain, void (*body)(void* ctx, i64 lo, i64 hi), void* ctx);
+void au_parallel_lock(void);
+void au_parallel_unlock(void);
+void* au_pheap_open(const char* path, u64 root_size, u64 hash);
+void* au_pheap_alloc(const void* in_heap, u64 size);
+int au_pheap_commit(const void* in_heap);
+void au_pheap_close(const void* in_heap);
+void f16_to_f32_n(f32* dst, const f16* src, i64 n);
+void f32_to_f16_n(f16* dst, const f32* src, i64 n);
+/* async functions: a frame starts with an au_task, see austere_rt.c */
+typedef struct au_task {
+    int (*resume)(struct au_task* t);
+    struct au_task* next;
+    struct au_task* waiter;
+    i64 wake_at;
+    int state, done, detached;
+} au_task;
+void au_spawn(au_task* t);
+void au_run(void);
+void au_yield(au_task* t);
+void au_sleep(au_task* t, i64 ms);
+void au_readable(au_task* t, int fd);
+void au_writable(au_task* t, int fd);
+int au_join(au_task* t, au_task* child);
+/* #bench (/BENCH): the generated runner's table of cases, see austere_rt.c */
+typedef struct au_bench {
+    const char* name;
+    void (*run)(u64 arg);
+    u64 arg;
+    f64 (*bytes)(u64 arg);
+} au_bench;
+int au_bench_run(int argc, char** argv, const au_bench* cases, int count);
 #endif
 #ifndef DLLEXPORT
     #ifdef _MSC_VER
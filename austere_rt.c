@@ -0,0 +1,762 @@
+// Austere runtime, compiled into the build directory and linked when generated code needs it.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#define poll WSAPoll
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sched.h>
+#endif
+#include <stdio.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _MSC_VER
+#define AU_RT_THREAD_LOCAL __declspec(thread)
+#else
+#define AU_RT_THREAD_LOCAL _Thread_local
+#endif
+
+/* parallel for (/NO-OPENMP)
+ * Iterations [0, count) are split into one contiguous range per thread. Each thread eats its own
+ * range from the front in grain sized chunks; when it runs dry it steals the back half of another
+ * thread's range. The calling thread takes part, nested calls run serially on the calling thread. */
+typedef void (*au_loop_body)(void* ctx, long long lo, long long hi);
+
+typedef struct au_range {
+    pthread_mutex_t lock;
+    long long lo, hi;
+    char pad[64];
+} au_range;
+
+static struct {
+    pthread_mutex_t lock, call, reduce;
+    pthread_cond_t wake, done;
+    int threads, active;
+    unsigned long long generation;
+    au_loop_body body;
+    void* ctx;
+    long long grain;
+    au_range* ranges;
+} au_workers = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+static AU_RT_THREAD_LOCAL int au_worker_id = -1;
+static pthread_once_t au_workers_once = PTHREAD_ONCE_INIT;
+
+static int au_take(int self, long long* lo, long long* hi) {
+    au_range* own = &au_workers.ranges[self];
+    for(;;) {
+        pthread_mutex_lock(&own->lock);
+        if (own->lo < own->hi) {
+            *lo = own->lo;
+            *hi = (own->hi - own->lo > au_workers.grain) ? own->lo + au_workers.grain : own->hi;
+            own->lo = *hi;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&own->lock);
+        int stolen = 0;
+        for(int i=1;i<au_workers.threads && !stolen;i++) {
+            au_range* victim = &au_workers.ranges[(self + i) % au_workers.threads];
+            pthread_mutex_lock(&victim->lock);
+            long long left = victim->hi - victim->lo;
+            if (left > 0) {
+                long long mid = (left > au_workers.grain) ? victim->lo + left / 2 : victim->lo;
+                long long end = victim->hi;
+                victim->hi = mid;
+                pthread_mutex_unlock(&victim->lock);
+                pthread_mutex_lock(&own->lock);
+                own->lo = mid;
+                own->hi = end;
+                pthread_mutex_unlock(&own->lock);
+                stolen = 1;
+            } else {
+                pthread_mutex_unlock(&victim->lock);
+            }
+        }
+        if (!stolen) return 0;
+    }
+}
+
+static void au_run_chunks(int self) {
+    long long lo, hi;
+    while (au_take(self, &lo, &hi)) au_workers.body(au_workers.ctx, lo, hi);
+}
+
+static void* au_worker(void* arg) {
+    int self = (int)(intptr_t)arg;
+    unsigned long long seen = 0;
+    au_worker_id = self;
+    for(;;) {
+        pthread_mutex_lock(&au_workers.lock);
+        while (au_workers.generation == seen) pthread_cond_wait(&au_workers.wake, &au_workers.lock);
+        seen = au_workers.generation;
+        pthread_mutex_unlock(&au_workers.lock);
+        au_run_chunks(self);
+        pthread_mutex_lock(&au_workers.lock);
+        if (!--au_workers.active) pthread_cond_signal(&au_workers.done);
+        pthread_mutex_unlock(&au_workers.lock);
+    }
+    return 0;
+}
+
+static void au_workers_start(void) {
+    int n = 0;
+    const char* env = getenv("AU_THREADS");
+    if (env) n = atoi(env);
+#ifdef _WIN32
+    if (n <= 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        n = si.dwNumberOfProcessors;
+    }
+#else
+    if (n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n <= 0) n = 1;
+    au_workers.ranges = (au_range*)calloc(n, sizeof(au_range));
+    if (!au_workers.ranges) n = 0;
+    for(int i=0;i<n;i++) pthread_mutex_init(&au_workers.ranges[i].lock, 0);
+    au_workers.threads = n;
+    for(int i=1;i<n;i++) {
+        pthread_t t;
+        if (pthread_create(&t, 0, au_worker, (void*)(intptr_t)i)) {
+            au_workers.threads = i;
+            break;
+        }
+        pthread_detach(t);
+    }
+}
+
+// grain > 0: chunk size, 0: automatic, -1: static (one chunk per thread unless work is stolen)
+void au_parallel_for(long long count, long long grain, au_loop_body body, void* ctx) {
+    if (count <= 0) return;
+    if (au_worker_id < 0) pthread_once(&au_workers_once, au_workers_start);
+    int n = au_workers.threads;
+    if (au_worker_id >= 0 || n <= 1 || count == 1) {
+        body(ctx, 0, count);
+        return;
+    }
+    if (grain == 0) grain = count / ((long long)n * 8);
+    if (grain < 0) grain = (count + n - 1) / n;
+    if (grain < 1) grain = 1;
+    pthread_mutex_lock(&au_workers.call);
+    for(int i=0;i<n;i++) {
+        au_workers.ranges[i].lo = count * i / n;
+        au_workers.ranges[i].hi = count * (i + 1) / n;
+    }
+    pthread_mutex_lock(&au_workers.lock);
+    au_workers.body = body;
+    au_workers.ctx = ctx;
+    au_workers.grain = grain;
+    au_workers.active = n - 1;
+    au_workers.generation++;
+    pthread_cond_broadcast(&au_workers.wake);
+    pthread_mutex_unlock(&au_workers.lock);
+    au_worker_id = 0;
+    au_run_chunks(0);
+    au_worker_id = -1;
+    pthread_mutex_lock(&au_workers.lock);
+    while (au_workers.active) pthread_cond_wait(&au_workers.done, &au_workers.lock);
+    pthread_mutex_unlock(&au_workers.lock);
+    pthread_mutex_unlock(&au_workers.call);
+}
+
+// reduce() clauses merge each chunk's partial result under this lock
+void au_parallel_lock(void) {
+    pthread_mutex_lock(&au_workers.reduce);
+}
+
+void au_parallel_unlock(void) {
+    pthread_mutex_unlock(&au_workers.reduce);
+}
+
+/* async functions
+ * Each async function is a resumable frame: resume() runs it until the next await (returns 0) or
+ * the end (returns 1). Tasks waiting for an fd or a timer are parked here; au_run() resumes
+ * them from one thread with epoll (poll() where there is no epoll) until nothing is left.
+ * au_task must match the definition in austere.h. */
+typedef struct au_task {
+    int (*resume)(struct au_task* t);
+    struct au_task* next;
+    struct au_task* waiter;
+    long long wake_at;
+    int state, done, detached;
+} au_task;
+
+static au_task* au_ready_head;
+static au_task* au_ready_tail;
+static au_task** au_timers;
+static int au_timer_count, au_timer_cap;
+static int au_fd_waiters;
+#ifdef __linux__
+static int au_epoll = -1;
+#else
+static struct pollfd* au_pollfds;
+static au_task** au_polltasks;
+static int au_poll_count, au_poll_cap;
+#endif
+
+static long long au_now_ms(void) {
+#ifdef _WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static void au_ready(au_task* t) {
+    t->next = 0;
+    if (au_ready_tail) au_ready_tail->next = t;
+    else au_ready_head = t;
+    au_ready_tail = t;
+}
+
+static void au_finish(au_task* t) {
+    t->done = 1;
+    if (t->waiter) au_ready(t->waiter);
+    else if (t->detached) free(t);
+}
+
+void au_spawn(au_task* t) {
+    t->detached = 1;
+    au_ready(t);
+}
+
+void au_yield(au_task* t) {
+    au_ready(t);
+}
+
+// runs the child inline until it first suspends; if it finishes right away the caller never suspends
+int au_join(au_task* t, au_task* child) {
+    if (child->resume(child)) {
+        child->done = 1;
+        return 1;
+    }
+    child->waiter = t;
+    return 0;
+}
+
+void au_sleep(au_task* t, long long ms) {
+    t->wake_at = au_now_ms() + ms;
+    if (au_timer_count == au_timer_cap) {
+        au_timer_cap = au_timer_cap ? au_timer_cap * 2 : 64;
+        au_timers = (au_task**)realloc(au_timers, au_timer_cap * sizeof(au_task*));
+    }
+    int i = au_timer_count++;
+    while (i && au_timers[(i - 1) / 2]->wake_at > t->wake_at) {
+        au_timers[i] = au_timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    au_timers[i] = t;
+}
+
+static au_task* au_timer_pop(void) {
+    au_task* top = au_timers[0];
+    au_task* last = au_timers[--au_timer_count];
+    int i = 0;
+    for(;;) {
+        int c = i * 2 + 1;
+        if (c >= au_timer_count) break;
+        if (c + 1 < au_timer_count && au_timers[c + 1]->wake_at < au_timers[c]->wake_at) c++;
+        if (au_timers[c]->wake_at >= last->wake_at) break;
+        au_timers[i] = au_timers[c];
+        i = c;
+    }
+    if (au_timer_count) au_timers[i] = last;
+    return top;
+}
+
+static void au_wait_fd(au_task* t, int fd, int write) {
+    au_fd_waiters++;
+#ifdef __linux__
+    if (au_epoll < 0) au_epoll = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = (write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    ev.data.ptr = t;
+    if (epoll_ctl(au_epoll, EPOLL_CTL_MOD, fd, &ev) && epoll_ctl(au_epoll, EPOLL_CTL_ADD, fd, &ev)) {
+        au_fd_waiters--;
+        au_ready(t);
+    }
+#else
+    if (au_poll_count == au_poll_cap) {
+        au_poll_cap = au_poll_cap ? au_poll_cap * 2 : 64;
+        au_pollfds = (struct pollfd*)realloc(au_pollfds, au_poll_cap * sizeof(struct pollfd));
+        au_polltasks = (au_task**)realloc(au_polltasks, au_poll_cap * sizeof(au_task*));
+    }
+    au_pollfds[au_poll_count].fd = fd;
+    au_pollfds[au_poll_count].events = write ? POLLOUT : POLLIN;
+    au_pollfds[au_poll_count].revents = 0;
+    au_polltasks[au_poll_count++] = t;
+#endif
+}
+
+void au_readable(au_task* t, int fd) {
+    au_wait_fd(t, fd, 0);
+}
+
+void au_writable(au_task* t, int fd) {
+    au_wait_fd(t, fd, 1);
+}
+
+void au_run(void) {
+    for(;;) {
+        while (au_ready_head) {
+            au_task* t = au_ready_head;
+            au_ready_head = t->next;
+            if (!au_ready_head) au_ready_tail = 0;
+            if (t->resume(t)) au_finish(t);
+        }
+        if (!au_fd_waiters && !au_timer_count) break;
+        int timeout = -1;
+        if (au_timer_count) {
+            long long left = au_timers[0]->wake_at - au_now_ms();
+            timeout = left > 0 ? (int)left : 0;
+        }
+        if (au_fd_waiters) {
+#ifdef __linux__
+            struct epoll_event events[256];
+            int n = epoll_wait(au_epoll, events, 256, timeout);
+            for(int i=0;i<n;i++) {
+                au_fd_waiters--;
+                au_ready((au_task*)events[i].data.ptr);
+            }
+#else
+            int n = poll(au_pollfds, au_poll_count, timeout);
+            for(int i=0;n > 0 && i<au_poll_count;i++) {
+                if (!au_pollfds[i].revents) continue;
+                au_fd_waiters--;
+                au_ready(au_polltasks[i]);
+                au_pollfds[i] = au_pollfds[--au_poll_count];
+                au_polltasks[i--] = au_polltasks[au_poll_count];
+            }
+#endif
+        } else if (timeout > 0) {
+#ifdef _WIN32
+            Sleep(timeout);
+#else
+            struct timespec ts = {timeout / 1000, (timeout % 1000) * 1000000L};
+            while (nanosleep(&ts, &ts) && errno == EINTR);
+#endif
+        }
+        long long now = au_now_ms();
+        while (au_timer_count && au_timers[0]->wake_at <= now) au_ready(au_timer_pop());
+    }
+}
+
+/* f16 arrays
+ * F16C (every AVX2-era x86) converts 8 values per instruction, AVX-512F 16; both round to
+ * nearest even, as does the scalar code, so results don't depend on the CPU. Compilers with
+ * _Float16 get a plain cast loop for the rest, which vectorizes on ARM. */
+static float au_half_to_float(unsigned short h) {
+    unsigned int sign = (unsigned int)(h & 0x8000) << 16, exp = (h >> 10) & 0x1f, man = h & 0x3ff, bits = sign;
+    float f;
+    if (exp == 0x1f) bits |= 0x7f800000 | (man << 13);
+    else if (exp) bits |= ((exp + 112) << 23) | (man << 13);
+    else if (man) return sign ? -(float)man / 16777216.0f : (float)man / 16777216.0f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+static unsigned short au_float_to_half(float f) {
+    unsigned int x, sign, man, half, rem, mid;
+    int exp;
+    memcpy(&x, &f, 4);
+    sign = (x >> 16) & 0x8000;
+    exp = (int)((x >> 23) & 0xff) - 112;
+    man = x & 0x7fffff;
+    if (((x >> 23) & 0xff) == 0xff) return (unsigned short)(sign | 0x7c00 | (man ? 0x200 : 0));
+    if (exp >= 31) return (unsigned short)(sign | 0x7c00);
+    if (exp <= 0) {
+        if (exp < -10) return (unsigned short)sign;
+        man |= 0x800000;
+        half = man >> (14 - exp);
+        rem = man & ((1u << (14 - exp)) - 1);
+        mid = 1u << (13 - exp);
+    } else {
+        half = ((unsigned int)exp << 10) | (man >> 13);
+        rem = man & 0x1fff;
+        mid = 0x1000;
+    }
+    if (rem > mid || (rem == mid && (half & 1))) half++;
+    return (unsigned short)(sign | half);
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define AU_F16_X86
+
+__attribute__((target("avx512f"))) static long long au_f16_to_f32_avx512(float* dst, const unsigned short* src, long long n) {
+    long long i = 0;
+    for(;i+16<=n;i+=16) _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(src + i))));
+    return i;
+}
+
+__attribute__((target("avx,f16c"))) static long long au_f16_to_f32_f16c(float* dst, const unsigned short* src, long long n) {
+    long long i = 0;
+    for(;i+8<=n;i+=8) _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+    return i;
+}
+
+__attribute__((target("avx512f"))) static long long au_f32_to_f16_avx512(unsigned short* dst, const float* src, long long n) {
+    long long i = 0;
+    for(;i+16<=n;i+=16) _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    return i;
+}
+
+__attribute__((target("avx,f16c"))) static long long au_f32_to_f16_f16c(unsigned short* dst, const float* src, long long n) {
+    long long i = 0;
+    for(;i+8<=n;i+=8) _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    return i;
+}
+#endif
+
+void f16_to_f32_n(float* dst, const void* src, long long n) {
+    const unsigned short* s = (const unsigned short*)src;
+    long long i = 0;
+#ifdef AU_F16_X86
+    if (__builtin_cpu_supports("avx512f")) i = au_f16_to_f32_avx512(dst, s, n);
+    else if (__builtin_cpu_supports("f16c")) i = au_f16_to_f32_f16c(dst, s, n);
+#endif
+#if defined(__FLT16_MAX__) && !defined(AU_F16_X86)
+    for(;i<n;i++) dst[i] = (float)((const _Float16*)src)[i];
+#else
+    for(;i<n;i++) dst[i] = au_half_to_float(s[i]);
+#endif
+}
+
+void f32_to_f16_n(void* dst, const float* src, long long n) {
+    unsigned short* d = (unsigned short*)dst;
+    long long i = 0;
+#ifdef AU_F16_X86
+    if (__builtin_cpu_supports("avx512f")) i = au_f32_to_f16_avx512(d, src, n);
+    else if (__builtin_cpu_supports("f16c")) i = au_f32_to_f16_f16c(d, src, n);
+#endif
+#if defined(__FLT16_MAX__) && !defined(AU_F16_X86)
+    for(;i<n;i++) ((_Float16*)dst)[i] = (_Float16)src[i];
+#else
+    for(;i<n;i++) d[i] = au_float_to_half(src[i]);
+#endif
+}
+
+/* persistent heaps
+ * A heap file is a header, the root object at AU_PHEAP_ROOT, then bump-allocated objects.
+ * The whole reserve is mapped up front and the file grows underneath it, so objects never
+ * move while the heap is open. Nothing is freed; pointers inside are au_rel offsets.
+ * Not implemented on Windows yet: au_pheap_open() fails there. */
+#define AU_PHEAP_MAGIC 0x3170616568756175ull
+#define AU_PHEAP_ROOT 64
+#define AU_PHEAP_RESERVE ((unsigned long long)1 << (sizeof(void*) == 8 ? 36 : 28))
+#define AU_PHEAP_MAX 64
+
+typedef struct au_pheap_header {
+    unsigned long long magic, hash, root_size, used;
+} au_pheap_header;
+
+static struct {
+    char* base;
+    int fd;
+    unsigned long long size;
+} au_pheaps[AU_PHEAP_MAX];
+static pthread_mutex_t au_pheap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int au_pheap_find(const void* p) {
+    for(int i=0;i<AU_PHEAP_MAX;i++) {
+        if (au_pheaps[i].base && (const char*)p >= au_pheaps[i].base && (const char*)p < au_pheaps[i].base + AU_PHEAP_RESERVE) return i;
+    }
+    return -1;
+}
+
+void* au_pheap_open(const char* path, unsigned long long root_size, unsigned long long hash) {
+#ifdef _WIN32
+    (void)path; (void)root_size; (void)hash;
+    return 0;
+#else
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return 0;
+    struct stat st;
+    unsigned long long size = 0;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return 0;
+    }
+    size = (unsigned long long)st.st_size;
+    // only a file this call created is formatted; anything else must already be a heap of this type,
+    // and big enough that the header and root object aren't past EOF (touching them would SIGBUS)
+    int fresh = !size;
+    if (!fresh && size < AU_PHEAP_ROOT + root_size) {
+        close(fd);
+        return 0;
+    }
+    if (fresh) {
+        size = 1 << 20;
+        while (size < AU_PHEAP_ROOT + root_size) size *= 2;
+        if (ftruncate(fd, (off_t)size)) {
+            close(fd);
+            return 0;
+        }
+    }
+    char* base = (char*)mmap(0, AU_PHEAP_RESERVE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+    au_pheap_header* h = (au_pheap_header*)base;
+    if (fresh) {
+        h->hash = hash;
+        h->root_size = root_size;
+        h->used = (AU_PHEAP_ROOT + root_size + 15) & ~15ull;
+        h->magic = AU_PHEAP_MAGIC;
+    } else if (h->magic != AU_PHEAP_MAGIC || h->hash != hash || h->root_size != root_size || h->used > size) {
+        munmap(base, AU_PHEAP_RESERVE);
+        close(fd);
+        return 0;
+    }
+    pthread_mutex_lock(&au_pheap_lock);
+    int slot = -1;
+    for(int i=0;i<AU_PHEAP_MAX && slot < 0;i++) {
+        if (!au_pheaps[i].base) slot = i;
+    }
+    if (slot >= 0) {
+        au_pheaps[slot].base = base;
+        au_pheaps[slot].fd = fd;
+        au_pheaps[slot].size = size;
+    }
+    pthread_mutex_unlock(&au_pheap_lock);
+    if (slot < 0) {
+        munmap(base, AU_PHEAP_RESERVE);
+        close(fd);
+        return 0;
+    }
+    return base + AU_PHEAP_ROOT;
+#endif
+}
+
+// new(root) T(...) in a persistent heap: falling back to malloc would leave a dangling offset in the file, so this aborts
+void* au_pheap_alloc(const void* in_heap, unsigned long long size) {
+    void* p = 0;
+    pthread_mutex_lock(&au_pheap_lock);
+    int i = au_pheap_find(in_heap);
+#ifndef _WIN32
+    if (i >= 0) {
+        au_pheap_header* h = (au_pheap_header*)au_pheaps[i].base;
+        unsigned long long at = (h->used + 15) & ~15ull;
+        unsigned long long need = at + size;
+        if (need > au_pheaps[i].size && need <= AU_PHEAP_RESERVE) {
+            unsigned long long grown = au_pheaps[i].size * 2;
+            while (grown < need) grown *= 2;
+            if (grown > AU_PHEAP_RESERVE) grown = AU_PHEAP_RESERVE;
+            if (!ftruncate(au_pheaps[i].fd, (off_t)grown)) au_pheaps[i].size = grown;
+        }
+        if (need <= au_pheaps[i].size) {
+            h->used = need;
+            p = au_pheaps[i].base + at;
+        }
+    }
+#endif
+    pthread_mutex_unlock(&au_pheap_lock);
+    if (!p) {
+        fprintf(stderr, "au_pheap_alloc: %s\n", i < 0 ? "object is not in an open persistent heap" : "persistent heap is full");
+        abort();
+    }
+    return p;
+}
+
+int au_pheap_commit(const void* in_heap) {
+    int r = -1;
+    pthread_mutex_lock(&au_pheap_lock);
+    int i = au_pheap_find(in_heap);
+#ifndef _WIN32
+    if (i >= 0) r = msync(au_pheaps[i].base, ((au_pheap_header*)au_pheaps[i].base)->used, MS_SYNC);
+#endif
+    pthread_mutex_unlock(&au_pheap_lock);
+    return r;
+}
+
+void au_pheap_close(const void* in_heap) {
+    pthread_mutex_lock(&au_pheap_lock);
+    int i = au_pheap_find(in_heap);
+#ifndef _WIN32
+    if (i >= 0) {
+        msync(au_pheaps[i].base, ((au_pheap_header*)au_pheaps[i].base)->used, MS_SYNC);
+        munmap(au_pheaps[i].base, AU_PHEAP_RESERVE);
+        close(au_pheaps[i].fd);
+        au_pheaps[i].base = 0;
+    }
+#endif
+    pthread_mutex_unlock(&au_pheap_lock);
+}
+
+/* #bench runner (/BENCH)
+ * The process is pinned to one CPU, then each case is warmed up and its iteration count doubled
+ * until a sample takes AU_BENCH_SAMPLE_NS. The median and median absolute deviation (MAD) of
+ * ns/op over the samples are reported, which a few preempted samples can't skew.
+ * au_bench must match the definition in austere.h. */
+typedef struct au_bench {
+    const char* name;
+    void (*run)(unsigned long long arg);
+    unsigned long long arg;
+    double (*bytes)(unsigned long long arg);
+} au_bench;
+
+#define AU_BENCH_SAMPLE_NS 10e6
+#define AU_BENCH_WARMUP_NS 50e6
+
+static double au_bench_clock(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+static int au_bench_pin(int cpu) {
+#if defined(_WIN32)
+    if (cpu < 0) cpu = (int)GetCurrentProcessorNumber();
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) ? cpu : -1;
+#elif defined(__linux__)
+    if (cpu < 0) cpu = sched_getcpu();
+    if (cpu < 0) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) ? -1 : cpu;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+static int au_bench_cmp(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double au_bench_median(double* v, int n) {
+    qsort(v, n, sizeof(double), au_bench_cmp);
+    return n & 1 ? v[n/2] : (v[n/2-1] + v[n/2]) * 0.5;
+}
+
+static double au_bench_time(const au_bench* c, unsigned long long iters) {
+    double t = au_bench_clock();
+    for(unsigned long long i=0;i<iters;i++) c->run(c->arg);
+    return au_bench_clock() - t;
+}
+
+// looks a case up in a report written by --json, 0 when it isn't there
+static double au_bench_baseline(const char* json, const char* name) {
+    if (!json) return 0;
+    char key[512];
+    snprintf(key, sizeof(key), "\"name\": \"%s\",", name);
+    const char* at = strstr(json, key);
+    if (!at) return 0;
+    at = strstr(at, "\"ns_per_op\": ");
+    return at ? atof(at + 13) : 0;
+}
+
+static char* au_bench_read(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* text = (char*)malloc(size + 1);
+    size = (long)fread(text, 1, size, fp);
+    text[size > 0 ? size : 0] = 0;
+    fclose(fp);
+    return text;
+}
+
+int au_bench_run(int argc, char** argv, const au_bench* cases, int count) {
+    const char* json_path = 0;
+    const char* filter = 0;
+    char* baseline = 0;
+    double threshold = 5;
+    int samples = 21, cpu = -1;
+    for(int i=1;i<argc;i++) {
+        const char* next = i+1 < argc ? argv[i+1] : 0;
+        if (!strcmp(argv[i], "--json") && next) json_path = argv[++i];
+        else if (!strcmp(argv[i], "--filter") && next) filter = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && next) threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--samples") && next) samples = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--cpu") && next) cpu = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--baseline") && next) {
+            baseline = au_bench_read(argv[++i]);
+            if (!baseline) {
+                fprintf(stderr, "au_bench: cannot read baseline %s\n", argv[i]);
+                return 2;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [--filter <text>] [--samples <n>] [--cpu <n>] [--json <out.json>] [--baseline <in.json>] [--threshold <percent>]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (samples < 3) samples = 3;
+    cpu = au_bench_pin(cpu);
+    if (cpu >= 0) printf("pinned to cpu %d\n", cpu);
+    FILE* json = json_path ? fopen(json_path, "w") : 0;
+    if (json) fprintf(json, "{\n  \"benchmarks\": [");
+    double* t = (double*)malloc(samples * sizeof(double));
+    int failed = 0, written = 0;
+    for(int k=0;k<count;k++) {
+        const au_bench* c = &cases[k];
+        if (filter && !strstr(c->name, filter)) continue;
+        unsigned long long iters = 1;
+        double spent = 0, elapsed;
+        while ((elapsed = au_bench_time(c, iters)) < AU_BENCH_SAMPLE_NS || spent < AU_BENCH_WARMUP_NS) {
+            spent += elapsed;
+            if (elapsed < AU_BENCH_SAMPLE_NS) iters *= 2;
+        }
+        for(int i=0;i<samples;i++) t[i] = au_bench_time(c, iters) / (double)iters;
+        double median = au_bench_median(t, samples);
+        for(int i=0;i<samples;i++) t[i] = t[i] > median ? t[i] - median : median - t[i];
+        double mad = au_bench_median(t, samples);
+        double bytes = c->bytes ? c->bytes(c->arg) : 0;
+        printf("%-40s %12.2f ns/op  +-%5.1f%%", c->name, median, median > 0 ? mad * 100 / median : 0);
+        if (bytes > 0) printf("  %12.0f B/op  %8.2f GB/s", bytes, bytes / median);
+        double base = au_bench_baseline(baseline, c->name);
+        if (base > 0) {
+            double change = (median - base) * 100 / base;
+            // slower than the threshold, and by more than the noise
+            int regressed = change > threshold && median - base > 3 * mad;
+            printf("  %+6.1f%%%s", change, regressed ? "  REGRESSION" : "");
+            failed |= regressed;
+        }
+        printf("\n");
+        fflush(stdout);
+        if (json) {
+            fprintf(json, "%s\n    {\"name\": \"%s\", \"ns_per_op\": %.4f, \"mad\": %.4f, \"bytes_per_op\": %.0f, \"iterations\": %llu, \"samples\": %d}", written++ ? "," : "", c->name, median, mad, bytes, iters, samples);
+        }
+    }
+    if (json) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    free(t);
+    free(baseline);
+    return failed;
+}